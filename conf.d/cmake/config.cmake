@@ -64,10 +64,17 @@ set (gcc_minimal_version 4.9)
 # PKG_CONFIG required packages
 # -----------------------------
 set (PKG_REQUIRED_LIST
-	json-c
+	json-c>=0.13
 	afb-daemon
 )
 
+# json-c must be built with ENABLE_THREADING (atomic reference counts),
+# which its headers don't tell. afb-daemon hands one pushed object to the
+# job threads of every listener, broadcast envelopes share their payload
+# by reference the same way. OFF only for a json-c built without it,
+# every envelope then gets its own copy of the payload.
+option(HS_JSONC_THREADING "json-c is built with ENABLE_THREADING" ON)
+
 # You can also consider to include libsystemd
 # -----------------------------------
 #list (APPEND PKG_REQUIRED_LIST libsystemd>=222)
@@ -19,6 +19,8 @@
 #endif
 
 #include "homescreen.h"
+#include "hs-stats.h"
+#include "hs-log.h"
 
 const char _error[] = "error";
 const char _application_id[] = "application_id";
@@ -44,7 +46,7 @@ int hs_instance::init(afb_api_t api)
         AFB_ERROR("client_manager is nullptr.");
         return -1;
     }
-    client_manager->init();
+    client_manager->init(api);
 
     if(app_info == nullptr) {
         AFB_ERROR("app_info is nullptr.");
@@ -142,29 +144,28 @@ static void pingSample(afb_req_t request)
 }
 
 /**
- * tap_shortcut notify for homescreen
- * When Shortcut area is tapped,  notify these applciations
+ * run tap_shortcut without reply, shared by verb and batch
  *
  * #### Parameters
- * Request key
- * - application_id   : application id
+ *  - ctxt : the request context
  *
  * #### Return
- * None
+ * 0 : success
+ * others : fail
  *
  */
-static void tap_shortcut (afb_req_t request)
+static int exec_tap_shortcut(HS_ReqCtxt &ctxt)
 {
     int ret = 0;
-    const char* value = afb_req_value(request, _application_id);
+    const char* value = ctxt.value(_application_id);
     if (value) {
         AFB_INFO("request appid = %s.", value);
-        ret = g_hs_instance->client_manager->handleRequest(request, __FUNCTION__, value);
+        ret = g_hs_instance->client_manager->handleRequest(ctxt, value);
         if(ret == AFB_REQ_NOT_STARTED_APPLICATION) {
             std::string id = g_hs_instance->app_info->getAppProperty(value, _keyId);
 	    if (!id.empty()) {
 		    HS_AfmMainProxy afm_proxy;
-		    afm_proxy.start(g_hs_instance, request, id);
+		    afm_proxy.start(g_hs_instance, ctxt.request, id);
 		    ret = 0;
 	    } else {
 		    ret = AFB_EVENT_BAD_REQUEST;
@@ -174,18 +175,51 @@ static void tap_shortcut (afb_req_t request)
     else {
         ret = AFB_EVENT_BAD_REQUEST;
     }
+    return ret;
+}
+
+/**
+ * tap_shortcut notify for homescreen
+ * When Shortcut area is tapped,  notify these applciations
+ *
+ * #### Parameters
+ * Request key
+ * - application_id   : application id
+ *
+ * #### Return
+ * None
+ *
+ */
+static void tap_shortcut (afb_req_t request)
+{
+    HS_ReqCtxt ctxt(request, HS_VERB_TAP_SHORTCUT);
+    int ret = exec_tap_shortcut(ctxt);
 
     if (ret) {
         afb_req_fail_f(request, "failed", "called %s, Unknown parameter", __FUNCTION__);
     }
     else {
-        struct json_object *res = json_object_new_object();
-        hs_add_object_to_json_object_func(res, __FUNCTION__, 2,
-          _error,  ret);
-        afb_req_success(request, res, "afb_event_push event [tap_shortcut]");
+        afb_req_success(request, hs_reply_object(ctxt.verb_id, ret), "afb_event_push event [tap_shortcut]");
     }
 }
 
+/**
+ * run on_screen_message without reply, shared by verb and batch
+ *
+ * #### Parameters
+ *  - ctxt : the request context
+ *
+ * #### Return
+ * 0 : success
+ * others : fail
+ *
+ */
+static int exec_on_screen_message(HS_ReqCtxt &ctxt)
+{
+    int ret = g_hs_instance->client_manager->handleRequest(ctxt);
+    return ret;
+}
+
 /**
  * HomeScreen OnScreen message
  *
@@ -199,18 +233,34 @@ static void tap_shortcut (afb_req_t request)
  */
 static void on_screen_message (afb_req_t request)
 {
-    int ret = g_hs_instance->client_manager->handleRequest(request, __FUNCTION__);
+    HS_ReqCtxt ctxt(request, HS_VERB_ON_SCREEN_MESSAGE);
+    int ret = exec_on_screen_message(ctxt);
+
     if (ret) {
         afb_req_fail_f(request, "failed", "called %s, Unknown parameter", __FUNCTION__);
     }
     else {
-        struct json_object *res = json_object_new_object();
-        hs_add_object_to_json_object_func(res, __FUNCTION__, 2,
-          _error,  ret);
-        afb_req_success(request, res, "afb_event_push event [on_screen_message]");
+        afb_req_success(request, hs_reply_object(ctxt.verb_id, ret), "afb_event_push event [on_screen_message]");
     }
 }
 
+/**
+ * run on_screen_reply without reply, shared by verb and batch
+ *
+ * #### Parameters
+ *  - ctxt : the request context
+ *
+ * #### Return
+ * 0 : success
+ * others : fail
+ *
+ */
+static int exec_on_screen_reply(HS_ReqCtxt &ctxt)
+{
+    int ret = g_hs_instance->client_manager->handleRequest(ctxt);
+    return ret;
+}
+
 /**
  * HomeScreen OnScreen Reply
  *
@@ -224,103 +274,133 @@ static void on_screen_message (afb_req_t request)
  */
 static void on_screen_reply (afb_req_t request)
 {
-    int ret = g_hs_instance->client_manager->handleRequest(request, __FUNCTION__);
+    HS_ReqCtxt ctxt(request, HS_VERB_ON_SCREEN_REPLY);
+    int ret = exec_on_screen_reply(ctxt);
+
     if (ret) {
         afb_req_fail_f(request, "failed", "called %s, Unknown parameter", __FUNCTION__);
     }
     else {
-        struct json_object *res = json_object_new_object();
-        hs_add_object_to_json_object_func(res, __FUNCTION__, 2,
-          _error,  ret);
-        afb_req_success(request, res, "afb_event_push event [on_screen_reply]");
+        afb_req_success(request, hs_reply_object(ctxt.verb_id, ret), "afb_event_push event [on_screen_reply]");
     }
 }
 
 /**
- * Subscribe event
+ * run subscribe without reply, shared by verb and batch
  *
  * #### Parameters
- *  - event  : Event name. Event list is written in libhomescreen.cpp
+ *  - ctxt : the request context
  *
  * #### Return
- * None
+ * 0 : success
+ * others : fail
  *
  */
-static void subscribe(afb_req_t request)
+static int exec_subscribe(HS_ReqCtxt &ctxt)
 {
     int ret = 0;
-    std::string req_appid = std::move(get_application_id(request));
-    if(!req_appid.empty()) {
-        ret = g_hs_instance->client_manager->handleRequest(request, __FUNCTION__, req_appid.c_str());
+    const char *req_appid = ctxt.callerId();
+    if(*req_appid != '\0') {
+        ret = g_hs_instance->client_manager->handleRequest(ctxt, req_appid);
     }
     else {
         ret = AFB_EVENT_BAD_REQUEST;
     }
+    return ret;
+}
+
+/**
+ * Subscribe event
+ *
+ * #### Parameters
+ *  - event  : Event name. Event list is written in libhomescreen.cpp
+ *
+ * #### Return
+ * None
+ *
+ */
+static void subscribe(afb_req_t request)
+{
+    HS_ReqCtxt ctxt(request, HS_VERB_SUBSCRIBE);
+    int ret = exec_subscribe(ctxt);
 
     if(ret) {
         afb_req_fail_f(request, "afb_req_subscribe failed", "called %s.", __FUNCTION__);
     }
     else {
-        struct json_object *res = json_object_new_object();
-        hs_add_object_to_json_object_func(res, __FUNCTION__, 2,
-            _error, ret);
-        afb_req_success_f(request, res, "homescreen binder subscribe.");
+        afb_req_success_f(request, hs_reply_object(ctxt.verb_id, ret), "homescreen binder subscribe.");
     }
 }
 
 /**
- * Unsubscribe event
+ * run unsubscribe without reply, shared by verb and batch
  *
  * #### Parameters
- *  - event  : Event name. Event list is written in libhomescreen.cpp
+ *  - ctxt : the request context
  *
  * #### Return
- * None
+ * 0 : success
+ * others : fail
  *
  */
-static void unsubscribe(afb_req_t request)
+static int exec_unsubscribe(HS_ReqCtxt &ctxt)
 {
     int ret = 0;
-    std::string req_appid = std::move(get_application_id(request));
-    if(!req_appid.empty()) {
-        ret = g_hs_instance->client_manager->handleRequest(request, __FUNCTION__, req_appid.c_str());
+    const char *req_appid = ctxt.callerId();
+    if(*req_appid != '\0') {
+        ret = g_hs_instance->client_manager->handleRequest(ctxt, req_appid);
     }
     else {
         ret = AFB_EVENT_BAD_REQUEST;
     }
+    return ret;
+}
+
+/**
+ * Unsubscribe event
+ *
+ * #### Parameters
+ *  - event  : Event name. Event list is written in libhomescreen.cpp
+ *
+ * #### Return
+ * None
+ *
+ */
+static void unsubscribe(afb_req_t request)
+{
+    HS_ReqCtxt ctxt(request, HS_VERB_UNSUBSCRIBE);
+    int ret = exec_unsubscribe(ctxt);
 
     if(ret) {
         afb_req_fail_f(request, "afb_req_unsubscribe failed", "called %s.", __FUNCTION__);
     }
     else {
-        struct json_object *res = json_object_new_object();
-        hs_add_object_to_json_object_func(res, __FUNCTION__, 2,
-            _error, ret);
-        afb_req_success_f(request, res, "homescreen binder unsubscribe success.");
+        afb_req_success_f(request, hs_reply_object(ctxt.verb_id, ret), "homescreen binder unsubscribe success.");
     }
 }
 
 /**
- * showWindow event
+ * run showWindow without reply, shared by verb and batch
  *
  * #### Parameters
- *  - request : the request
+ *  - ctxt : the request context
  *
  * #### Return
- * None
+ * 0 : success
+ * others : fail
  *
  */
-static void showWindow(afb_req_t request)
+static int exec_showWindow(HS_ReqCtxt &ctxt)
 {
     int ret = 0;
-    const char* value = afb_req_value(request, _application_id);
+    const char* value = ctxt.value(_application_id);
     if (value) {
-        ret = g_hs_instance->client_manager->handleRequest(request, __FUNCTION__, value);
+        ret = g_hs_instance->client_manager->handleRequest(ctxt, value);
         if(ret == AFB_REQ_NOT_STARTED_APPLICATION) {
             std::string id = g_hs_instance->app_info->getAppProperty(value, _keyId);
 	    if (!id.empty()) {
 		    HS_AfmMainProxy afm_proxy;
-		    afm_proxy.start(g_hs_instance, request, id);
+		    afm_proxy.start(g_hs_instance, ctxt.request, id);
 		    ret = 0;
 	    } else {
 		    ret = AFB_EVENT_BAD_REQUEST;
@@ -330,82 +410,143 @@ static void showWindow(afb_req_t request)
     else {
         ret = AFB_EVENT_BAD_REQUEST;
     }
+    return ret;
+}
+
+/**
+ * showWindow event
+ *
+ * #### Parameters
+ *  - request : the request
+ *
+ * #### Return
+ * None
+ *
+ */
+static void showWindow(afb_req_t request)
+{
+    HS_ReqCtxt ctxt(request, HS_VERB_SHOW_WINDOW);
+    int ret = exec_showWindow(ctxt);
 
     if (ret) {
         afb_req_fail_f(request, "failed", "called %s, Unknown parameter", __FUNCTION__);
     }
     else {
-        struct json_object *res = json_object_new_object();
-        hs_add_object_to_json_object_func(res, __FUNCTION__, 2,
-          _error,  ret);
-        afb_req_success(request, res, "afb_event_push event [showWindow]");
+        afb_req_success(request, hs_reply_object(ctxt.verb_id, ret), "afb_event_push event [showWindow]");
     }
 }
 
 /**
- * hideWindow event
+ * run hideWindow without reply, shared by verb and batch
  *
  * #### Parameters
- *  - request : the request
+ *  - ctxt : the request context
  *
  * #### Return
- * None
+ * 0 : success
+ * others : fail
  *
  */
-static void hideWindow(afb_req_t request)
+static int exec_hideWindow(HS_ReqCtxt &ctxt)
 {
     int ret = 0;
-    const char* value = afb_req_value(request, _application_id);
+    const char* value = ctxt.value(_application_id);
     if (value) {
-        ret = g_hs_instance->client_manager->handleRequest(request, __FUNCTION__, value);
+        ret = g_hs_instance->client_manager->handleRequest(ctxt, value);
     }
     else {
         ret = AFB_EVENT_BAD_REQUEST;
     }
+    return ret;
+}
+
+/**
+ * hideWindow event
+ *
+ * #### Parameters
+ *  - request : the request
+ *
+ * #### Return
+ * None
+ *
+ */
+static void hideWindow(afb_req_t request)
+{
+    HS_ReqCtxt ctxt(request, HS_VERB_HIDE_WINDOW);
+    int ret = exec_hideWindow(ctxt);
 
     if (ret) {
         afb_req_fail_f(request, "failed", "called %s, Unknown parameter", __FUNCTION__);
     }
     else {
-        struct json_object *res = json_object_new_object();
-        hs_add_object_to_json_object_func(res, __FUNCTION__, 2,
-          _error,  ret);
-        afb_req_success(request, res, "afb_event_push event [hideWindow]");
+        afb_req_success(request, hs_reply_object(ctxt.verb_id, ret), "afb_event_push event [hideWindow]");
     }
 }
 
 /**
- * replyShowWindow event
+ * run replyShowWindow without reply, shared by verb and batch
  *
  * #### Parameters
- *  - request : the request
+ *  - ctxt : the request context
  *
  * #### Return
- *  None
+ * 0 : success
+ * others : fail
  *
  */
-static void replyShowWindow(afb_req_t request)
+static int exec_replyShowWindow(HS_ReqCtxt &ctxt)
 {
     int ret = 0;
-    const char* value = afb_req_value(request, _application_id);
+    const char* value = ctxt.value(_application_id);
     if (value) {
-        ret = g_hs_instance->client_manager->handleRequest(request, __FUNCTION__, value);
+        ret = g_hs_instance->client_manager->handleRequest(ctxt, value);
     }
     else {
         ret = AFB_EVENT_BAD_REQUEST;
     }
+    return ret;
+}
+
+/**
+ * replyShowWindow event
+ *
+ * #### Parameters
+ *  - request : the request
+ *
+ * #### Return
+ *  None
+ *
+ */
+static void replyShowWindow(afb_req_t request)
+{
+    HS_ReqCtxt ctxt(request, HS_VERB_REPLY_SHOW_WINDOW);
+    int ret = exec_replyShowWindow(ctxt);
 
     if (ret) {
         afb_req_fail_f(request, "failed", "called %s, Unknown parameter", __FUNCTION__);
     }
     else {
-        struct json_object *res = json_object_new_object();
-        hs_add_object_to_json_object_func(res, __FUNCTION__, 2,
-          _error,  ret);
-        afb_req_success(request, res, "afb_event_push event [replyShowWindow]");
+        afb_req_success(request, hs_reply_object(ctxt.verb_id, ret), "afb_event_push event [replyShowWindow]");
     }
 }
 
+/**
+ * run showNotification without reply, shared by verb and batch
+ *
+ * #### Parameters
+ *  - ctxt : the request context
+ *
+ * #### Return
+ * 0 : success
+ * others : fail
+ *
+ */
+static int exec_showNotification(HS_ReqCtxt &ctxt)
+{
+    int ret = g_hs_instance->client_manager->handleRequest(ctxt, "homescreen");
+    return ret;
+}
+
 /**
  * showNotification event
  *
@@ -420,18 +561,34 @@ static void replyShowWindow(afb_req_t request)
  */
 static void showNotification(afb_req_t request)
 {
-    int ret = g_hs_instance->client_manager->handleRequest(request, __FUNCTION__, "homescreen");
+    HS_ReqCtxt ctxt(request, HS_VERB_SHOW_NOTIFICATION);
+    int ret = exec_showNotification(ctxt);
+
     if (ret) {
         afb_req_fail_f(request, "failed", "called %s, Unknown parameter", __FUNCTION__);
     }
     else {
-        struct json_object *res = json_object_new_object();
-        hs_add_object_to_json_object_func(res, __FUNCTION__, 2,
-          _error,  ret);
-        afb_req_success(request, res, "afb_event_push event [showNotification]");
+        afb_req_success(request, hs_reply_object(ctxt.verb_id, ret), "afb_event_push event [showNotification]");
     }
 }
 
+/**
+ * run showInformation without reply, shared by verb and batch
+ *
+ * #### Parameters
+ *  - ctxt : the request context
+ *
+ * #### Return
+ * 0 : success
+ * others : fail
+ *
+ */
+static int exec_showInformation(HS_ReqCtxt &ctxt)
+{
+    int ret = g_hs_instance->client_manager->handleRequest(ctxt, "homescreen");
+    return ret;
+}
+
 /**
  * showInformation event
  *
@@ -446,15 +603,14 @@ static void showNotification(afb_req_t request)
  */
 static void showInformation(afb_req_t request)
 {
-    int ret = g_hs_instance->client_manager->handleRequest(request,  __FUNCTION__, "homescreen");
+    HS_ReqCtxt ctxt(request, HS_VERB_SHOW_INFORMATION);
+    int ret = exec_showInformation(ctxt);
+
     if (ret) {
         afb_req_fail_f(request, "failed", "called %s, Unknown parameter", __FUNCTION__);
     }
     else {
-        struct json_object *res = json_object_new_object();
-        hs_add_object_to_json_object_func(res, __FUNCTION__, 2,
-          _error,  ret);
-        afb_req_success(request, res, "afb_event_push event [showInformation]");
+        afb_req_success(request, hs_reply_object(ctxt.verb_id, ret), "afb_event_push event [showInformation]");
     }
 }
 
@@ -480,23 +636,222 @@ static void getRunnables(afb_req_t request)
     afb_req_success_f(request, res, "homescreen binder unsubscribe success.");
 }
 
+/**
+ * get latest telemetry frame
+ *
+ * the snapshot is read without lock, so polling apps never
+ * block the serial reader.
+ *
+ * #### Parameters
+ *  - request : the request
+ *
+ * #### Return
+ * None
+ *
+ */
+static void getTelemetry(afb_req_t request)
+{
+    HS_TelemetryFrame frame;
+    if(!HS_Telemetry::instance()->getLatest(&frame)) {
+        afb_req_fail_f(request, "failed", "called %s, no telemetry received yet", __FUNCTION__);
+        return;
+    }
+
+    struct json_object *j_data = json_object_new_object();
+    hs_add_telemetry_to_json_object(j_data, frame);
+    json_object_object_add(j_data, "timestamp", json_object_new_int64((int64_t)frame.timestamp));
+
+    struct json_object *res = json_object_new_object();
+    hs_add_object_to_json_object_func(res, __FUNCTION__, 2, _error, 0);
+    json_object_object_add(res, _keyData, j_data);
+    afb_req_success(request, res, "homescreen binder getTelemetry success.");
+}
+
+/**
+ * get binding statistics
+ *
+ * lock statistics are collected only when built with HS_LOCK_STATS,
+ * otherwise "locks" is empty and "lock_stats" is false. verb latency
+ * likewise needs HS_VERB_STATS.
+ *
+ * #### Parameters
+ *  - request : the request
+ *
+ * #### Return
+ * None
+ *
+ */
+static void getStats(afb_req_t request)
+{
+    struct json_object *j_data = json_object_new_object();
+#ifdef HS_LOCK_STATS
+    json_object_object_add(j_data, "lock_stats", json_object_new_boolean(1));
+#else
+    json_object_object_add(j_data, "lock_stats", json_object_new_boolean(0));
+#endif
+    json_object_object_add(j_data, "locks", hs_lock_stats_to_json());
+#ifdef HS_VERB_STATS
+    json_object_object_add(j_data, "verb_stats", json_object_new_boolean(1));
+#else
+    json_object_object_add(j_data, "verb_stats", json_object_new_boolean(0));
+#endif
+    json_object_object_add(j_data, "verbs", hs_verb_stats_to_json());
+
+    HS_PoolStats clients, ctxts;
+    HS_ClientManager::instance()->getPoolStats(&clients, &ctxts);
+    struct json_object *j_pool = json_object_new_object();
+    json_object_object_add(j_pool, "clients_in_use", json_object_new_int(clients.in_use));
+    json_object_object_add(j_pool, "clients_peak", json_object_new_int(clients.peak));
+    json_object_object_add(j_pool, "clients_slot_reuses", json_object_new_int64(clients.slot_reuses));
+    json_object_object_add(j_pool, "clients_slab_allocs", json_object_new_int64(clients.slab_allocs));
+    json_object_object_add(j_pool, "ctxts_in_use", json_object_new_int(ctxts.in_use));
+    json_object_object_add(j_pool, "ctxts_peak", json_object_new_int(ctxts.peak));
+    json_object_object_add(j_pool, "ctxts_slot_reuses", json_object_new_int64(ctxts.slot_reuses));
+    json_object_object_add(j_pool, "ctxts_slab_allocs", json_object_new_int64(ctxts.slab_allocs));
+    json_object_object_add(j_data, "pool", j_pool);
+
+    HS_RegistryStats registry;
+    HS_ClientManager::instance()->getRegistryStats(&registry);
+    struct json_object *j_registry = json_object_new_object();
+    json_object_object_add(j_registry, "adds", json_object_new_int64(registry.adds));
+    json_object_object_add(j_registry, "removes", json_object_new_int64(registry.removes));
+    json_object_object_add(j_registry, "heap_allocs", json_object_new_int64(registry.heap_allocs));
+    json_object_object_add(j_data, "registry", j_registry);
+
+    struct json_object *res = json_object_new_object();
+    hs_add_object_to_json_object_func(res, __FUNCTION__, 2, _error, 0);
+    json_object_object_add(res, _keyData, j_data);
+    afb_req_success(request, res, "homescreen binder getStats success.");
+}
+
+// verbs which can run inside batch, indexed by HS_VerbId
+static int (* const batch_list[HS_CATALOG_MAX])(HS_ReqCtxt &ctxt) = {
+    exec_tap_shortcut,          // HS_VERB_TAP_SHORTCUT
+    exec_on_screen_message,     // HS_VERB_ON_SCREEN_MESSAGE
+    exec_on_screen_reply,       // HS_VERB_ON_SCREEN_REPLY
+    exec_showWindow,            // HS_VERB_SHOW_WINDOW
+    exec_hideWindow,            // HS_VERB_HIDE_WINDOW
+    exec_replyShowWindow,       // HS_VERB_REPLY_SHOW_WINDOW
+    exec_showNotification,      // HS_VERB_SHOW_NOTIFICATION
+    exec_showInformation,       // HS_VERB_SHOW_INFORMATION
+    nullptr,                    // HS_EVENT_APPLICATION_LIST_CHANGED
+    nullptr,                    // HS_EVENT_TELEMETRY
+    exec_subscribe,             // HS_VERB_SUBSCRIBE
+    exec_unsubscribe            // HS_VERB_UNSUBSCRIBE
+};
+
+/**
+ * run several verbs in one request, in order
+ *
+ * #### Parameters
+ * Request key
+ * - ops : array of {"verb":"subscribe", "args":{"event":"tap_shortcut"}},
+ *         the request itself may be the array, verb is matched ignoring case
+ *
+ * #### Return
+ * None
+ *
+ */
+static void batch(afb_req_t request)
+{
+    struct json_object *ops = afb_req_json(request);
+    if(!json_object_is_type(ops, json_type_array)
+       && !(json_object_object_get_ex(ops, "ops", &ops) && json_object_is_type(ops, json_type_array))) {
+        afb_req_fail_f(request, "failed", "called %s, ops array is required", __FUNCTION__);
+        return;
+    }
+
+    struct json_object *empty = json_object_new_object();
+    struct json_object *results = json_object_new_array();
+    int count = json_object_array_length(ops);
+    for(int i = 0; i < count; ++i) {
+        struct json_object *op = json_object_array_get_idx(ops, i);
+        struct json_object *j_verb = nullptr, *j_args = nullptr;
+        json_object_object_get_ex(op, "verb", &j_verb);
+        if(!json_object_object_get_ex(op, "args", &j_args) || !json_object_is_type(j_args, json_type_object))
+            j_args = empty;
+
+        const char *verb = json_object_get_string(j_verb);
+        int verb_id = hs_catalog_lookup_nocase(verb);
+        int ret = AFB_EVENT_BAD_REQUEST;
+        if(verb_id >= 0 && batch_list[verb_id] != nullptr) {
+            HS_ReqCtxt ctxt(request, verb_id, j_args);
+            ret = batch_list[verb_id](ctxt);
+        }
+
+        struct json_object *result = json_object_new_object();
+        json_object_object_add(result, "verb", json_object_new_string(verb != nullptr ? verb : ""));
+        json_object_object_add(result, _error, json_object_new_int(ret));
+        json_object_array_add(results, result);
+    }
+    json_object_put(empty);
+
+    struct json_object *res = json_object_new_object();
+    hs_add_object_to_json_object_func(res, __FUNCTION__, 2, _error, 0);
+    json_object_object_add(res, _keyData, results);
+    afb_req_success(request, res, "homescreen binder batch success.");
+}
+
+#ifdef HS_VERB_STATS
+/**
+ * run verb callback and record its latency
+ *
+ * #### Parameters
+ *  - request : the request
+ *
+ * #### Return
+ * None
+ *
+ */
+template<int verb_id, void (*callback)(afb_req_t)>
+static void timed_verb(afb_req_t request)
+{
+    uint64_t start = HS_Telemetry::now();
+    callback(request);
+    hs_verb_stats_record(verb_id, HS_Telemetry::now() - start);
+}
+
+/**
+ * write verb latency to log at process exit
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+static void dump_verb_stats(void)
+{
+    hs_verb_stats_dump();
+    HS_Logger::instance()->stop();
+}
+
+#define HS_VERB_CALLBACK(id, f)     timed_verb<id, f>
+#else
+#define HS_VERB_CALLBACK(id, f)     f
+#endif
+
 /*
  * array of the verbs exported to afb-daemon
  */
 static const afb_verb_t verbs[]= {
-    /* VERB'S NAME                 FUNCTION TO CALL                  */
-    { .verb="ping",              .callback=pingSample             },
-    { .verb="tap_shortcut",      .callback=tap_shortcut           },
-    { .verb="showWindow",        .callback=showWindow             },
-    { .verb="hideWindow",        .callback=hideWindow             },
-    { .verb="replyShowWindow",   .callback=replyShowWindow        },
-    { .verb="on_screen_message", .callback=on_screen_message      },
-    { .verb="on_screen_reply",   .callback=on_screen_reply        },
-    { .verb="subscribe",         .callback=subscribe              },
-    { .verb="unsubscribe",       .callback=unsubscribe            },
-    { .verb="showNotification",  .callback=showNotification       },
-    { .verb="showInformation",   .callback=showInformation        },
-    { .verb="getRunnables",      .callback=getRunnables           },
+    /* VERB'S NAME                                    FUNCTION TO CALL                                                    */
+    { .verb=hs_catalog[HS_VERB_PING],                .callback=HS_VERB_CALLBACK(HS_VERB_PING, pingSample)                     },
+    { .verb=hs_catalog[HS_VERB_TAP_SHORTCUT],        .callback=HS_VERB_CALLBACK(HS_VERB_TAP_SHORTCUT, tap_shortcut)           },
+    { .verb=hs_catalog[HS_VERB_SHOW_WINDOW],         .callback=HS_VERB_CALLBACK(HS_VERB_SHOW_WINDOW, showWindow)              },
+    { .verb=hs_catalog[HS_VERB_HIDE_WINDOW],         .callback=HS_VERB_CALLBACK(HS_VERB_HIDE_WINDOW, hideWindow)              },
+    { .verb=hs_catalog[HS_VERB_REPLY_SHOW_WINDOW],   .callback=HS_VERB_CALLBACK(HS_VERB_REPLY_SHOW_WINDOW, replyShowWindow)   },
+    { .verb=hs_catalog[HS_VERB_ON_SCREEN_MESSAGE],   .callback=HS_VERB_CALLBACK(HS_VERB_ON_SCREEN_MESSAGE, on_screen_message) },
+    { .verb=hs_catalog[HS_VERB_ON_SCREEN_REPLY],     .callback=HS_VERB_CALLBACK(HS_VERB_ON_SCREEN_REPLY, on_screen_reply)     },
+    { .verb=hs_catalog[HS_VERB_SUBSCRIBE],           .callback=HS_VERB_CALLBACK(HS_VERB_SUBSCRIBE, subscribe)                 },
+    { .verb=hs_catalog[HS_VERB_UNSUBSCRIBE],         .callback=HS_VERB_CALLBACK(HS_VERB_UNSUBSCRIBE, unsubscribe)             },
+    { .verb=hs_catalog[HS_VERB_SHOW_NOTIFICATION],   .callback=HS_VERB_CALLBACK(HS_VERB_SHOW_NOTIFICATION, showNotification)  },
+    { .verb=hs_catalog[HS_VERB_SHOW_INFORMATION],    .callback=HS_VERB_CALLBACK(HS_VERB_SHOW_INFORMATION, showInformation)    },
+    { .verb=hs_catalog[HS_VERB_GET_RUNNABLES],       .callback=HS_VERB_CALLBACK(HS_VERB_GET_RUNNABLES, getRunnables)          },
+    { .verb=hs_catalog[HS_VERB_GET_TELEMETRY],       .callback=HS_VERB_CALLBACK(HS_VERB_GET_TELEMETRY, getTelemetry)          },
+    { .verb=hs_catalog[HS_VERB_BATCH],               .callback=HS_VERB_CALLBACK(HS_VERB_BATCH, batch)                         },
+    { .verb=hs_catalog[HS_VERB_GET_STATS],           .callback=HS_VERB_CALLBACK(HS_VERB_GET_STATS, getStats)                  },
     {NULL } /* marker for end of the array */
 };
 
@@ -543,6 +898,14 @@ static int init(afb_api_t api)
         return -1;
     }
 
+#ifdef HS_VERB_STATS
+    static bool dump_registered = false;
+    if(!dump_registered) {
+        atexit(dump_verb_stats);
+        dump_registered = true;
+    }
+#endif
+
     return g_hs_instance->init(api);
 }
 
@@ -19,28 +19,16 @@
 #include "hs-appinfo.h"
 #include "hs-helper.h"
 #include "hs-clientmanager.h"
+#include "hs-serialmanager.h"
+#include "hs-log.h"
+#include "hs-telemetry.h"
+#include "hs-publisher.h"
+#include "hs-scheduler.h"
 
 
-#include <stdio.h>      // standard input / output functions
-#include <stdlib.h>
-#include <string.h>     // string function definitions
-#include <unistd.h>     // UNIX standard function definitions
-#include <fcntl.h>      // File control definitions
-#include <errno.h>      // Error number definitions
-#include <termios.h>    // POSIX terminal control definitions
-#include <pthread.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <errno.h>
-#include <string.h>
-#include <sys/types.h>
-#include <time.h> 
-
 #define RETRY_CNT 10
+#define HEARTBEAT_INTERVAL_MS   1000
+#define STATS_INTERVAL_MS       10000
 
 const char _keyName[] = "name";
 const char _keyVersion[] = "version";
@@ -112,419 +100,91 @@ HS_AppInfo::~HS_AppInfo()
         delete afmmain;
 }
 
-typedef struct 
-{
-    unsigned char msgRcv[0xFF];
-    unsigned char iCount;
-    unsigned char isValid;
-}SERIAL_DATA_QUEUE;
-
-pthread_mutex_t mutexsync;
-pthread_mutex_t mutexSerialSync;
-pthread_t tid;
-int fdUSB = 0x00;
-int icount = 0x00;
-SERIAL_DATA_QUEUE g_serial_rcv;
-
-void printLogMsg(char *msg)
-{
-    FILE *f = fopen("/home/1001/app-data/agl-service-homescreen/file.txt", "a");
-
-    if (f == NULL)
-    {
-        printf("Error opening file!\n");
-        exit(1);
-    }
+HS_SerialManager *g_serial_manager = nullptr;
+HS_TelemetryPublisher *g_publisher = nullptr;
 
-    fprintf(f, "%s\n", msg);
-    fclose(f);
+static void onTelemetryFrame(const HS_TelemetryFrame &frame)
+{
+    g_publisher->publish(frame);
 }
 
-void setSerialRcv(unsigned char *buffer, int icound)
+static void statsTask(void *arg)
 {
-    pthread_mutex_lock (&mutexsync);
-    int idx = 0x00;
-    g_serial_rcv.iCount = icound;
-    for(idx = 0x00; idx < icound; idx++)
-    {
-        g_serial_rcv.msgRcv[idx] = buffer[idx];
-    }
-    g_serial_rcv.isValid = 0x20;
-    pthread_mutex_unlock (&mutexsync);
+    (void)arg;
+    HS_SerialStats serial;
+    HS_PublisherStats pub;
+    HS_LogStats log;
+    HS_SchedulerStats sched;
+
+    g_serial_manager->updateRate();
+    for(int i = 0; i < g_serial_manager->getPortCount(); ++i) {
+        g_serial_manager->getStats(i, &serial);
+        HS_LOG_INFO("serial %s: state=%u reconnects=%llu frames=%llu bad_crc=%llu resyncs=%llu queue_dropped=%llu %u bytes/s %u frames/s",
+                    g_serial_manager->getDevice(i), serial.state, (unsigned long long)serial.reconnects,
+                    (unsigned long long)serial.frames, (unsigned long long)serial.bad_crc,
+                    (unsigned long long)serial.resyncs, (unsigned long long)serial.queue_dropped,
+                    serial.bytes_per_sec, serial.frames_per_sec);
+    }
+    g_publisher->getStats(&pub);
+    HS_Logger::instance()->getStats(&log);
+    HS_Scheduler::instance()->getStats(&sched);
+    HS_LOG_INFO("publisher: clients=%u frames=%llu queue_dropped=%llu client_dropped=%llu",
+                pub.clients, (unsigned long long)pub.frames,
+                (unsigned long long)pub.queue_dropped, (unsigned long long)pub.client_dropped);
+    HS_LOG_INFO("log: written=%llu dropped=%llu batches=%llu",
+                (unsigned long long)log.written_bytes, (unsigned long long)log.dropped,
+                (unsigned long long)log.batches);
+    HS_LOG_INFO("scheduler: wakeups=%llu runs=%llu jitter avg=%lluus max=%lluus",
+                (unsigned long long)sched.wakeups, (unsigned long long)sched.runs,
+                (unsigned long long)sched.jitter_avg_us, (unsigned long long)sched.jitter_max_us);
+
+    HS_PoolStats clients, ctxts;
+    HS_ClientManager::instance()->getPoolStats(&clients, &ctxts);
+    HS_LOG_INFO("client pool: in_use=%u peak=%u slot_allocs=%llu slot_reuses=%llu slot_frees=%llu slab_allocs=%llu oversize_allocs=%llu",
+                clients.in_use, clients.peak, (unsigned long long)clients.slot_allocs,
+                (unsigned long long)clients.slot_reuses, (unsigned long long)clients.slot_frees,
+                (unsigned long long)clients.slab_allocs, (unsigned long long)clients.oversize_allocs);
+    HS_LOG_INFO("context pool: in_use=%u peak=%u slot_allocs=%llu slot_reuses=%llu slot_frees=%llu slab_allocs=%llu",
+                ctxts.in_use, ctxts.peak, (unsigned long long)ctxts.slot_allocs,
+                (unsigned long long)ctxts.slot_reuses, (unsigned long long)ctxts.slot_frees,
+                (unsigned long long)ctxts.slab_allocs);
+    HS_RegistryStats registry;
+    HS_ClientManager::instance()->getRegistryStats(&registry);
+    HS_LOG_INFO("client registry: adds=%llu removes=%llu heap_allocs=%llu",
+                (unsigned long long)registry.adds, (unsigned long long)registry.removes,
+                (unsigned long long)registry.heap_allocs);
 }
 
 bool sendHeartBeat()
 {
     bool retVal = false;
-    pthread_mutex_lock (&mutexSerialSync);
-    if(fdUSB != 0x00)
+    if(g_serial_manager != nullptr)
     {
         char syncByte = 0xA5;
-        if(write (fdUSB, &syncByte, 1) < 0x00)
+        retVal = true;
+        for(int i = 0; i < g_serial_manager->getPortCount(); ++i)
         {
-            printLogMsg((char*)"sendHeartBeat, write socket error\n\r");
+            if(g_serial_manager->write(i, &syncByte, 1) < 0x00)
+            {
+                HS_LOG_WARNING("sendHeartBeat, write serial %s error", g_serial_manager->getDevice(i));
+                retVal = false;
+            }
         }
-        else
+        if(retVal)
         {
-            printLogMsg((char*)"sendHeartBeat successed\n\r");
-            retVal = true;
+            HS_LOG_DEBUG("sendHeartBeat successed");
         }
-        
     }
-    pthread_mutex_unlock (&mutexSerialSync);
     return retVal;
 }
 
-void printserial()
+#ifdef HS_SERIAL_HEARTBEAT
+static void heartBeatTask(void *arg)
 {
-    return;
-    printLogMsg((char*)"printserial");
-    
-    close(fdUSB);fdUSB = open( "/dev/ttyS0", O_RDWR| O_NOCTTY );
-    struct termios tty;
-    struct termios tty_old;
-    memset (&tty, 0, sizeof tty);
-
-    /* Error Handling */
-    if ( tcgetattr ( fdUSB, &tty ) != 0 ) {
-       //printLogMsg((char*)"Open /dev/ttyS0 failed, fdUSB: %d", fdUSB);
-        printLogMsg((char*)"printserial Open /dev/ttyS0 failed");
-       return;
-    }
-    printLogMsg((char*)"printserial do serial config");
-    /* Save old tty parameters */
-    tty_old = tty;
-
-    /* Set Baud Rate */
-    cfsetospeed (&tty, (speed_t)B115200);
-
-    /* Setting other Port Stuff */
-    tty.c_cflag     &=  ~PARENB;            // Make 8n1
-    tty.c_cflag     &=  ~CSTOPB;
-    tty.c_cflag     &=  ~CSIZE;
-    tty.c_cflag     |=  CS8;
-
-    tty.c_cflag     &=  ~CRTSCTS;           // no flow control
-    tty.c_cc[VMIN]   =  1;                  // read doesn't block
-    tty.c_cc[VTIME]  =  5;                  // 0.5 seconds read timeout
-    tty.c_cflag     |=  CREAD | CLOCAL;     // turn on READ & ignore ctrl lines
-
-    /* Make raw */
-    cfmakeraw(&tty);
-
-    printLogMsg((char*)"printserial flush usb");
-    /* Flush Port, then applies attributes */
-    tcflush( fdUSB, TCIFLUSH );
-    if ( tcsetattr ( fdUSB, TCSANOW, &tty ) != 0) {
-        close(fdUSB);
-       printLogMsg((char*)"printserial flush usb failed");
-       return;
-    }
-    if(fdUSB != 0x00)
-    {
-        printLogMsg((char*)"printserial writing data to serial");
-        if(write (fdUSB, "K-Auto hello!\n", strlen("K-Auto hello!\n")) < 0x00)
-        {
-            close(fdUSB);
-            fdUSB = 0x00;
-            return;
-        }
-    }
-    fdUSB = 0x00;
+    (void)arg;
+    sendHeartBeat();
 }
-#define UNUSED(x) (void)(x)
-void* doSomeThing(void *arg)
-{
-    UNUSED(arg);
-    usleep(10000000);//10s
-    #if 0
-    int seconds          = 0x00;
-    int odo              = 12500;
-    int curSpeed         = 30;
-    int batteryLev       = 60;
-    int signalLightLeft  = 0x00;
-    int signalLightRight = 0x01;
-
 #endif
-    int listenfd = 0, connfd = 0;
-    struct sockaddr_in serv_addr; 
-
-    char sendBuff[1025];
-    //time_t ticks; 
-
-    listenfd = socket(AF_INET, SOCK_STREAM, 0);
-    memset(&serv_addr, '0', sizeof(serv_addr));
-    memset(sendBuff, '0', sizeof(sendBuff)); 
-
-    serv_addr.sin_family = AF_INET;
-    //serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    //serv_addr.sin_addr.s_addr = inet_addr("127.0.0.1");//htonl("127.0.0.1");
-    serv_addr.sin_addr.s_addr = inet_addr("127.192.90.189");//htonl("127.0.0.1");
-    serv_addr.sin_port = htons(5000); 
-
-    bind(listenfd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)); 
-
-    listen(listenfd, 10); 
-    connfd = accept(listenfd, (struct sockaddr*)NULL, NULL); 
-    while(1)
-    {
-        //usleep(1000000);//1s
-        //printserial();
-        //continue;
-        //{"odo":12500, "curSpeed":30, "batteryLev":60, signalLightLeft:0, signalLightRight:1}
-        
-        //ticks = time(NULL);
-        #if 0
-        if((seconds % 3) == 0x00)
-        {
-            odo++;
-        }
-
-        if((seconds % 1) == 0x00)
-        {
-            curSpeed = (rand() % (70 - 55 + 1)) + 55;
-        }
-
-        if((seconds % 5) == 0x00 && batteryLev > 0x00)
-        {
-            batteryLev--;
-        }
-
-        if((seconds % 10) == 0x00)
-        {
-            signalLightLeft = 0x01;
-            signalLightRight = 0x00;
-        }
-        else
-        {
-            signalLightLeft = 0x00;
-            signalLightRight = 0x01;
-        }
-
-        snprintf(sendBuff, sizeof(sendBuff), "{\"odo\":%d, \"curSpeed\":%d, \"batteryLev\":%d, \"signalLightLeft\":%d, \"signalLightRight\":%d}", odo, curSpeed, batteryLev, signalLightLeft, signalLightRight);
-        if(write(connfd, sendBuff, strlen(sendBuff)) < 0x00)
-        {
-            printLogMsg((char*)"write socket error\n\r");
-        }
-        seconds++;
-        #endif
-        pthread_mutex_lock (&mutexsync);
-        if(g_serial_rcv.isValid == 0x20)
-        {
-            g_serial_rcv.isValid = 0x00;
-            snprintf(sendBuff, sizeof(sendBuff), "{\"odo\":%d, \"curSpeed\":%d, \"batteryLev\":%d, \"signalLightLeft\":%d, \"signalLightRight\":%d}", g_serial_rcv.msgRcv[3], g_serial_rcv.msgRcv[4], g_serial_rcv.msgRcv[5], g_serial_rcv.msgRcv[6], g_serial_rcv.msgRcv[7]);
-            if(write(connfd, sendBuff, strlen(sendBuff)) < 0x00)
-            {
-                printLogMsg((char*)"write socket error\n\r");
-            }
-        }
-        pthread_mutex_unlock (&mutexsync);
-        usleep(1000000);//1s
-    }
-    close(connfd);
-
-    return NULL;
-}
-
-#define MAX_RECEIVING_BUFFER   0xFF
-//CRC POLYNOMIAL parameter
-#define CRC_POLYNOMIAL  0x131
-
-#define MESSAGE_HEADER_01  0xA5
-#define MESSAGE_HEADER_02  0x5A
-
-enum State_enum 
-{
-    CLI_COMMAND_UNKNOWN     =   0x00,
-    CLI_COMMAND_HEADER_01   =   0x01,
-    CLI_COMMAND_HEADER_02   =   0x02,
-    CLI_COMMAND_OPTYPE      =   0x03,
-    CLI_COMMAND_DATA_LENGTH =   0x04,
-    CLI_COMMAND_DATA        =   0x05,
-    CLI_COMMAND_CRC         =   0x06,
-    CLI_COMMAND_COMPLETE    =   0x07,
-};
-
-unsigned char m_arru8_receivingbuff[MAX_RECEIVING_BUFFER];
-char msgBuffer[0xFF];
-int heartBeatCount = 0x00;
-#define UNUSED(x) (void)(x)
-
-int openSerialPort()
-{
-    int serialfd = 0x00;
-    //serialfd = open( "/dev/ttyS0", O_RDWR| O_NOCTTY | O_NDELAY );
-    serialfd = open( "/dev/ttyUSB0", O_RDWR| O_NOCTTY | O_NDELAY );
-    struct termios tty;
-    struct termios tty_old;
-    memset (&tty, 0, sizeof tty);
-
-    /* Error Handling */
-    if ( tcgetattr ( serialfd, &tty ) != 0 ) {
-       printLogMsg((char*)"openSerialPort Open /dev/ttyS0 failed");
-       return 0x00;
-    }
-    tcflush(fdUSB, TCIOFLUSH);
-    /* Save old tty parameters */
-    tty_old = tty;
-    /* Set Baud Rate */
-    cfsetospeed (&tty, (speed_t)B115200);
-
-    /* Setting other Port Stuff */
-    tty.c_cflag     &=  ~PARENB;            // Make 8n1
-    tty.c_cflag     &=  ~CSTOPB;
-    tty.c_cflag     &=  ~CSIZE;
-    tty.c_cflag     |=  CS8;
-
-    tty.c_cflag     &=  ~CRTSCTS;           // no flow control
-    tty.c_cc[VMIN]   =  1;                  // read doesn't block
-    tty.c_cc[VTIME]  =  5;                  // 0.5 seconds read timeout
-    tty.c_cflag     |=  CREAD | CLOCAL;     // turn on READ & ignore ctrl lines
-
-    /* Make raw */
-    cfmakeraw(&tty);
-    cfsetispeed(&tty, cfgetospeed(&tty));
-    /* Flush Port, then applies attributes */
-    tcflush( fdUSB, TCIFLUSH );
-    if ( tcsetattr ( fdUSB, TCSANOW, &tty ) != 0) {
-        close(fdUSB);
-        printLogMsg((char*)"openSerialPort tcsetattr failed");
-       return 0x00;
-    }
-    return serialfd;
-}
-
-void* kAutoSerialComunication(void *arg)
-{
-    UNUSED(arg);
-    bool isSerialInitSuccessed = false;
-    int m_u8state = CLI_COMMAND_UNKNOWN;
-    unsigned char m_u8receiveCount = 0x00;
-    unsigned char u8datalength = 0x00;
-    static char inChar = 0x00;
-
-    pthread_mutex_lock (&mutexSerialSync);
-    if(fdUSB != 0x00)
-    {
-        close(fdUSB);
-    }
-    while(isSerialInitSuccessed == false)
-    {   
-        fdUSB = openSerialPort();
-        if(fdUSB != 0x00)
-        {
-            isSerialInitSuccessed = true;
-        }
-    }
-    pthread_mutex_unlock (&mutexSerialSync);
-    m_u8state = CLI_COMMAND_HEADER_01;
-    while(1)
-    {
-        pthread_mutex_lock (&mutexSerialSync);
-        if(read(fdUSB, &inChar, 1) > 0x00)
-        {
-            memset(msgBuffer, 0x00, 0xFF);
-            sprintf((char*)msgBuffer, "Data received: %d, m_u8state: %d\n\r", inChar, m_u8state);
-            printLogMsg((char*)msgBuffer);
-            switch(m_u8state)
-            {
-                case CLI_COMMAND_HEADER_01:
-                {
-                    if(inChar == MESSAGE_HEADER_01)
-                    {
-                        m_u8receiveCount = 0x00;
-                        m_arru8_receivingbuff[m_u8receiveCount++] = inChar;
-                        m_u8state = CLI_COMMAND_HEADER_02;
-                        printLogMsg((char*)"Receive header 1\n\r");
-                    }
-                }
-                break;
-                case CLI_COMMAND_HEADER_02:
-                {
-                    if(inChar == MESSAGE_HEADER_02)
-                    {
-                        m_arru8_receivingbuff[m_u8receiveCount++] = inChar;
-                        m_u8state = CLI_COMMAND_DATA_LENGTH;
-                        printLogMsg((char*)"Receive header 2\n\r");
-                    }
-                }
-                break;
-                case CLI_COMMAND_DATA_LENGTH:
-                {
-                    u8datalength = inChar;
-                    m_arru8_receivingbuff[m_u8receiveCount++] = inChar;
-                    m_u8state = CLI_COMMAND_DATA;
-                    printLogMsg((char*)"Receive data length\n\r");
-                }
-                break;
-                case CLI_COMMAND_DATA:
-                {
-                    if( u8datalength > 0)
-                    {
-                        m_arru8_receivingbuff[m_u8receiveCount++] = inChar;
-                        u8datalength--;
-                        printLogMsg((char*)"Receive data ..\n\r");
-                    }
-                    if(u8datalength == 0)
-                    {
-                        m_u8state = CLI_COMMAND_CRC;
-                        //printLogMsg((char*)"Receive data complete, switch to CRC\n\r");
-                    }
-                }
-                break;
-                case CLI_COMMAND_CRC:
-                {
-                    m_arru8_receivingbuff[m_u8receiveCount++] = inChar;
-
-                    /*complete*/
-                    //msg.deserialize((const char*)m_arru8_receivingbuff, m_u8receiveCount);
-                    setSerialRcv((unsigned char *)m_arru8_receivingbuff, m_u8receiveCount);
-                    /*reset package*/
-                    m_u8state = CLI_COMMAND_HEADER_01;
-                    m_u8receiveCount = 0x00;
-                    u8datalength = 0x00;
-                    printLogMsg((char*)"Receive CRC, message complete\n\r");
-                }
-                break;
-            }
-        }
-        pthread_mutex_unlock (&mutexSerialSync);
-        #if 0
-        usleep(1000);//delay for 1 milisecond
-        if(heartBeatCount++ > 2000)//2 seconds
-        {
-            if(sendHeartBeat() == false)
-            {
-                close(fdUSB);
-                printLogMsg((char*)"Serial write failed, try to open again\n\r");
-                fdUSB = openSerialPort();
-            }
-            heartBeatCount = 0x00;
-        }
-        #endif
-    }
-    if(fdUSB != 0x00)
-    {
-        close(fdUSB);
-    }
-    return NULL;
-}
-int iCountDelay = 0x00;
-void* kAutoHeartBeat(void *arg)
-{
-    UNUSED(arg);
-    while(1)
-    {
-        if(iCountDelay > 1000)
-        {
-            sendHeartBeat();
-            iCountDelay = 0x00;
-        }
-        usleep(1000);//delay for 1 milisecond
-        iCountDelay++;
-    }
-    return NULL;
-}
 
 /**
  * get instance
@@ -541,11 +201,18 @@ HS_AppInfo* HS_AppInfo::instance(void)
     if(me == nullptr)
     {
         me = new HS_AppInfo();
-        pthread_mutex_init(&mutexsync, NULL);
-        pthread_mutex_init(&mutexSerialSync, NULL);
-        pthread_create(&tid, NULL, &doSomeThing, NULL);
-        pthread_create(&tid, NULL, &kAutoSerialComunication, NULL);
-        //pthread_create(&tid, NULL, &kAutoHeartBeat, NULL);
+        g_publisher = new HS_TelemetryPublisher();
+        g_publisher->start();
+        HS_Telemetry::instance()->addListener(onTelemetryFrame);
+        g_serial_manager = new HS_SerialManager();
+        g_serial_manager->start();
+
+        HS_Scheduler *scheduler = HS_Scheduler::instance();
+#ifdef HS_SERIAL_HEARTBEAT
+        scheduler->addTask("heartbeat", heartBeatTask, nullptr, HEARTBEAT_INTERVAL_MS, HEARTBEAT_INTERVAL_MS);
+#endif
+        scheduler->addTask("stats", statsTask, nullptr, STATS_INTERVAL_MS, STATS_INTERVAL_MS);
+        scheduler->start();
     }
 
     return me;
@@ -688,8 +355,8 @@ int HS_AppInfo::updateAppDetailList(afb_api_t api, struct json_object *object)
                 json_object_put(j_runnable);
                 return 1;
             }
-            addAppDetail(json_object_get(j_found));
-            pushAppListChangedEvent(_keyInstall, j_found);
+            addAppDetail(j_found);
+            pushAppListChangedEvent(_keyInstall, json_object_get(j_found));    // j_found belongs to j_runnable
         }
         else {
             AFB_ERROR("get runnalbes failed.");
@@ -760,7 +427,7 @@ void HS_AppInfo::addAppDetail(struct json_object *object)
         return;
     }
 
-    std::lock_guard<std::mutex> lock(this->mtx);
+    std::lock_guard<HS_Mutex> lock(this->mtx);
     appid2name[appid] = info.name;
     name2appid[info.name] = appid;
     app_detail_list[appid] = std::move(info);
@@ -778,7 +445,7 @@ void HS_AppInfo::addAppDetail(struct json_object *object)
  */
 void HS_AppInfo::removeAppDetail(std::string appid)
 {
-    std::lock_guard<std::mutex> lock(this->mtx);
+    std::lock_guard<HS_Mutex> lock(this->mtx);
     auto it = app_detail_list.find(appid);
     if(it != app_detail_list.end()) {
         appid2name.erase(appid);
@@ -880,7 +547,7 @@ void HS_AppInfo::getRunnables(struct json_object **object)
         return;
     }
 
-    std::lock_guard<std::mutex> lock(this->mtx);
+    std::lock_guard<HS_Mutex> lock(this->mtx);
     for(auto it : app_detail_list) {
         if(!it.second.periphery)
             json_object_array_add(*object, json_tokener_parse(it.second.detail.c_str()));
@@ -900,7 +567,7 @@ void HS_AppInfo::getRunnables(struct json_object **object)
  */
 std::string HS_AppInfo::checkAppId(const std::string &appid)
 {
-    std::lock_guard<std::mutex> lock(this->mtx);
+    std::lock_guard<HS_Mutex> lock(this->mtx);
     auto it_appid = appid2name.find(appid);
     if(it_appid != appid2name.end())
         return it_appid->first;
@@ -25,6 +25,7 @@
 #include <unordered_map>
 #include "hs-helper.h"
 #include "hs-proxy.h"
+#include "hs-stats.h"
 
 
 struct AppDetail {
@@ -81,7 +82,7 @@ private:
     std::unordered_map<std::string, std::string> appid2name;
     std::unordered_map<std::string, std::string> name2appid;
     std::unordered_map<std::string, AppDetail> app_detail_list;
-    std::mutex mtx;
+    HS_Mutex mtx {"appinfo"};
 };
 
 #endif // HOMESCREEN_APPINFO_H
\ No newline at end of file
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * broadcast memory regression test.
+ *
+ * runs HS_AppInfo and HS_ClientManager against the afb and json-c
+ * simulators in sim/, subscribes many clients and a topic subscriber to
+ * application-list-changed, then broadcasts it through afm-main install
+ * and uninstall events (updateAppDetailList) and through pushEvent.
+ * every application_id, type and parameter object put in a pushed
+ * envelope is tracked, once afb released the envelopes only the tracking
+ * reference and the owner's one may be left, and no object may leak.
+ * one broadcast allocates the type string and an envelope per client and
+ * topic, payload copies only without HS_JSONC_THREADING.
+ * a topic event without subscriber must not be pushed at all.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <getopt.h>
+#include "hs-clientmanager.h"
+#include "hs-appinfo.h"
+
+#define TEST_BROADCASTS     100
+#define TEST_APP_ID         "newapp@0.1"
+#define TEST_TOPIC_EVENTS   2       // application-list-changed and telemetry topics
+#define TEST_PARAM_OBJECTS  3       // {"operation":"install", "data":TEST_APP_ID}
+
+// owner of an envelope child once afb released the envelope
+enum TestRole {
+    TEST_ROLE_APPID = 0,    // HS_Client j_appid when shared
+    TEST_ROLE_TYPE,
+    TEST_ROLE_PARAM,
+    TEST_ROLE_MAX
+};
+
+static const char *role_key[TEST_ROLE_MAX] = {
+    "application_id",
+    "type",
+    "parameter"
+};
+
+static struct afb_api_x3 api = { "homescreen" };
+static std::mutex tracked_mtx;
+static std::map<struct json_object*, int> tracked;     // object to TestRole
+static unsigned int app_count = 256;
+static int failures = 0;
+
+#define TEST_CHECK(cond, ...) \
+    do { \
+        if(!(cond)) { \
+            fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+            ++failures; \
+        } \
+    } while(0)
+
+/**
+ * take a reference of every envelope child, called in pushing thread
+ *
+ * #### Parameters
+ *  - event : the afb event
+ *  - object : envelope pushed
+ *
+ * #### Return
+ * None
+ *
+ */
+static void onPush(afb_event_t event, struct json_object *object)
+{
+    (void)event;
+    std::lock_guard<std::mutex> lock(tracked_mtx);
+    for(int role = 0; role < TEST_ROLE_MAX; ++role) {
+        struct json_object *child;
+        if(!json_object_object_get_ex(object, role_key[role], &child))
+            continue;
+        if(tracked.emplace(child, role).second)
+            json_object_get(child);
+    }
+}
+
+/**
+ * afm-main answer, runnables lists app0 ... app<count-1> and TEST_APP_ID
+ *
+ * #### Parameters
+ *  - apiname : called api
+ *  - verb : called verb
+ *  - args : call arguments
+ *  - object : [OUT] reply
+ *
+ * #### Return
+ * 0 : success
+ * -1 : not simulated
+ *
+ */
+static int onCall(const char *apiname, const char *verb, struct json_object *args, struct json_object **object)
+{
+    (void)args;
+    if(strcmp(apiname, "afm-main") != 0 || strcmp(verb, "runnables") != 0)
+        return -1;
+
+    *object = json_object_new_array();
+    for(unsigned int i = 0; i <= app_count; ++i) {
+        std::string id = i < app_count ? "app" + std::to_string(i) + "@0.1" : TEST_APP_ID;
+        struct json_object *app = json_object_new_object();
+        json_object_object_add(app, "id", json_object_new_string(id.c_str()));
+        json_object_object_add(app, "name", json_object_new_string(id.substr(0, id.find('@')).c_str()));
+        json_object_array_add(*object, app);
+    }
+    return 0;
+}
+
+static afb_req_t subscribeClient(const std::string &appid, bool topic)
+{
+    afb_req_t req = new afb_req_x3();
+    req->api = &api;
+    req->appid = strdup(appid.c_str());
+    req->args = json_object_new_object();
+    json_object_object_add(req->args, "event", json_object_new_string("application-list-changed"));
+    if(topic)
+        json_object_object_add(req->args, "topic", json_object_new_string("1"));
+
+    HS_ReqCtxt ctxt(req, HS_VERB_SUBSCRIBE);
+    int ret = HS_ClientManager::instance()->handleRequest(ctxt, req->appid);
+    TEST_CHECK(ret == 0, "subscribe %s returned %d", appid.c_str(), ret);
+    return req;
+}
+
+static void closeClient(afb_req_t req)
+{
+    if(req->context_free != nullptr)
+        req->context_free(req->context);
+    json_object_put(req->args);
+    free((void*)req->appid);
+    delete req;
+}
+
+/**
+ * check and release tracked envelope children after afb released every
+ * envelope, a child is then only held by the test, and the client too
+ * when it is the client's own application id
+ *
+ * #### Parameters
+ *  - what : checked step
+ *
+ * #### Return
+ * number of tracked objects
+ *
+ */
+static size_t checkTracked(const char *what)
+{
+    hs_sim_drain();
+    std::lock_guard<std::mutex> lock(tracked_mtx);
+    size_t count = tracked.size();
+    for(auto &t : tracked) {
+        int expected = 1;
+#ifdef HS_JSONC_THREADING
+        if(t.second == TEST_ROLE_APPID)
+            expected = 2;
+#endif
+        int ref = hs_sim_json_refcount(t.first);
+        TEST_CHECK(ref == expected, "%s: %s object has %d references, expected %d",
+                   what, role_key[t.second], ref, expected);
+        json_object_put(t.first);
+    }
+    tracked.clear();
+    return count;
+}
+
+/**
+ * json objects one pushEvent broadcast allocates, the parameter is built
+ * by the caller
+ *
+ * #### Parameters
+ *  - clients : clients subscribed to the event
+ *
+ * #### Return
+ * object count
+ *
+ */
+static long broadcastAllocs(long clients)
+{
+    long allocs = 1 + clients + 1;     // type string, client envelopes, topic envelope
+#ifndef HS_JSONC_THREADING
+    // client envelope copies application_id, type and parameter, topic one type and parameter
+    allocs += clients * (2 + TEST_PARAM_OBJECTS) + 1 + TEST_PARAM_OBJECTS;
+#endif
+    return allocs;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "usage: %s [-n clients]\n"
+        "  -n  clients subscribed to application-list-changed (default 256)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch(opt) {
+        case 'n': app_count = strtoul(optarg, NULL, 0); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(app_count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    hs_sim_set_call_handler(onCall);
+    hs_sim_set_push_hook(onPush);
+    long events_before = hs_sim_event_count();
+    HS_ClientManager *manager = HS_ClientManager::instance();
+    manager->init(&api);
+    HS_AppInfo *appinfo = HS_AppInfo::instance();
+    if(appinfo->init(&api) != 0) {
+        fprintf(stderr, "FAIL appinfo init\n");
+        return 1;
+    }
+
+    long live_before = hs_sim_json_live();
+    std::vector<afb_req_t> sessions;
+    for(unsigned int i = 0; i < app_count; ++i)
+        sessions.push_back(subscribeClient("app" + std::to_string(i), false));
+    sessions.push_back(subscribeClient("topic", true));
+    long live_subscribed = hs_sim_json_live();
+    unsigned long pushes_before = hs_sim_event_pushes();
+
+    // afm-main install : j_found belongs to runnables reply
+    struct json_object *j_event = json_object_new_object();
+    json_object_object_add(j_event, "operation", json_object_new_string("install"));
+    json_object_object_add(j_event, "data", json_object_new_string(TEST_APP_ID));
+    appinfo->onEvent(&api, "afm-main/application-list-changed", j_event);
+    json_object_put(j_event);
+    size_t count = checkTracked("install");
+    TEST_CHECK(count > 0, "install pushed nothing");
+
+    // afm-main uninstall : the data object belongs to event object
+    struct json_object *j_data = json_object_new_string(TEST_APP_ID);
+    j_event = json_object_new_object();
+    json_object_object_add(j_event, "operation", json_object_new_string("uninstall"));
+    json_object_object_add(j_event, "data", j_data);
+    appinfo->onEvent(&api, "afm-main/application-list-changed", j_event);
+    checkTracked("uninstall");
+    TEST_CHECK(hs_sim_json_refcount(j_event) == 1 && hs_sim_json_refcount(j_data) == 1,
+               "uninstall event has %d references, data %d",
+               hs_sim_json_refcount(j_event), hs_sim_json_refcount(j_data));
+    json_object_put(j_event);
+
+    for(int n = 0; n < TEST_BROADCASTS; ++n) {
+        struct json_object *param = json_object_new_object();
+        json_object_object_add(param, "operation", json_object_new_string("install"));
+        json_object_object_add(param, "data", json_object_new_string(TEST_APP_ID));
+        long allocs_before = hs_sim_json_allocs();
+        manager->pushEvent("application-list-changed", param);
+        long allocs = hs_sim_json_allocs() - allocs_before;
+        if(n == 0)
+            TEST_CHECK(allocs == broadcastAllocs(app_count), "broadcast allocated %ld objects, expected %ld",
+                       allocs, broadcastAllocs(app_count));
+    }
+    checkTracked("pushEvent");
+
+    // every client and the topic event got every broadcast
+    unsigned long pushes = hs_sim_event_pushes() - pushes_before;
+    unsigned long expected_pushes = (unsigned long)(TEST_BROADCASTS + 2) * (app_count + 1);
+    TEST_CHECK(pushes == expected_pushes, "%lu pushes, expected %lu", pushes, expected_pushes);
+    TEST_CHECK(hs_sim_json_live() == live_subscribed, "%ld objects leaked by broadcast",
+               hs_sim_json_live() - live_subscribed);
+
+    // nothing is built nor pushed for a topic without subscriber
+    unsigned long unheard = hs_sim_event_unheard();
+    HS_TelemetryFrame frame = {};
+    manager->pushTelemetry(frame);
+    afb_req_t topic = sessions.back();
+    HS_ReqCtxt unsubscribe(topic, HS_VERB_UNSUBSCRIBE);
+    TEST_CHECK(manager->handleRequest(unsubscribe, topic->appid) == 0, "unsubscribe topic failed");
+    manager->pushEvent("application-list-changed", json_object_new_object());
+    checkTracked("topic unsubscribed");
+    TEST_CHECK(hs_sim_event_unheard() == unheard, "%lu pushes to topic without subscriber",
+               hs_sim_event_unheard() - unheard);
+
+    for(auto req : sessions)
+        closeClient(req);
+    TEST_CHECK(hs_sim_json_live() == live_before, "%ld objects leaked by clients",
+               hs_sim_json_live() - live_before);
+    TEST_CHECK(hs_sim_event_count() - events_before == TEST_TOPIC_EVENTS,
+               "%ld client events not released", hs_sim_event_count() - events_before - TEST_TOPIC_EVENTS);
+
+    printf("%s: %u clients, %lu pushes, %d failures\n", failures ? "FAIL" : "PASS", app_count, pushes, failures);
+    return failures ? 1 : 0;
+}
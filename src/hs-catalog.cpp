@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include <strings.h>
+#include "hs-catalog.h"
+
+// hash slot to catalog id, -1 : empty slot
+struct HS_CatalogTable {
+    int8_t id[HS_CATALOG_HASH_SIZE];
+};
+
+static constexpr HS_CatalogTable hs_catalog_make_table(void)
+{
+    HS_CatalogTable table = {};
+    for(int i = 0; i < HS_CATALOG_HASH_SIZE; ++i)
+        table.id[i] = -1;
+    for(int i = 0; i < HS_CATALOG_MAX; ++i)
+        table.id[hs_catalog_hash(hs_catalog[i], HS_CATALOG_SEED)] = (int8_t)i;
+    return table;
+}
+
+static constexpr HS_CatalogTable catalog_table = hs_catalog_make_table();
+
+static_assert(HS_CATALOG_MAX <= HS_CATALOG_HASH_SIZE, "catalog hash table too small");
+static constexpr bool hs_catalog_table_ok(void)
+{
+    for(int i = 0; i < HS_CATALOG_MAX; ++i)
+        if(catalog_table.id[hs_catalog_hash(hs_catalog[i], HS_CATALOG_SEED)] != i)
+            return false;
+    return true;
+}
+
+static_assert(hs_catalog_table_ok(), "catalog hash is not perfect");
+
+/**
+ * get id of event or verb name
+ *
+ * #### Parameters
+ *  - name : event or verb name
+ *
+ * #### Return
+ * HS_EventId or HS_VerbId
+ * -1 : not in catalog
+ *
+ */
+int hs_catalog_lookup(const char *name)
+{
+    if(name == nullptr)
+        return -1;
+
+    int id = catalog_table.id[hs_catalog_hash(name, HS_CATALOG_SEED)];
+    if(id < 0 || strcmp(name, hs_catalog[id]) != 0)
+        return -1;
+    return id;
+}
+
+/**
+ * get id of event or verb name ignoring case, liked "ShowWindow".
+ * exact names are found by hash, other spellings by scanning catalog
+ *
+ * #### Parameters
+ *  - name : event or verb name
+ *
+ * #### Return
+ * HS_EventId or HS_VerbId
+ * -1 : not in catalog
+ *
+ */
+int hs_catalog_lookup_nocase(const char *name)
+{
+    int id = hs_catalog_lookup(name);
+    if(id >= 0 || name == nullptr)
+        return id;
+
+    for(int i = 0; i < HS_CATALOG_MAX; ++i) {
+        if(strcasecmp(name, hs_catalog[i]) == 0)
+            return i;
+    }
+    return -1;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOMESCREEN_CATALOG_H
+#define HOMESCREEN_CATALOG_H
+
+#include <cstdint>
+
+// homescreen event ids, an event id indexes the subscription bitset
+enum HS_EventId {
+    HS_EVENT_TAP_SHORTCUT = 0,
+    HS_EVENT_ON_SCREEN_MESSAGE,
+    HS_EVENT_ON_SCREEN_REPLY,
+    HS_EVENT_SHOW_WINDOW,
+    HS_EVENT_HIDE_WINDOW,
+    HS_EVENT_REPLY_SHOW_WINDOW,
+    HS_EVENT_SHOW_NOTIFICATION,
+    HS_EVENT_SHOW_INFORMATION,
+    HS_EVENT_APPLICATION_LIST_CHANGED,
+    HS_EVENT_TELEMETRY,
+    HS_EVENT_MAX
+};
+
+// homescreen verb ids, a verb which pushes the event of the same name
+// has the id of the event, the other verbs follow the events
+enum HS_VerbId {
+    HS_VERB_TAP_SHORTCUT = HS_EVENT_TAP_SHORTCUT,
+    HS_VERB_ON_SCREEN_MESSAGE = HS_EVENT_ON_SCREEN_MESSAGE,
+    HS_VERB_ON_SCREEN_REPLY = HS_EVENT_ON_SCREEN_REPLY,
+    HS_VERB_SHOW_WINDOW = HS_EVENT_SHOW_WINDOW,
+    HS_VERB_HIDE_WINDOW = HS_EVENT_HIDE_WINDOW,
+    HS_VERB_REPLY_SHOW_WINDOW = HS_EVENT_REPLY_SHOW_WINDOW,
+    HS_VERB_SHOW_NOTIFICATION = HS_EVENT_SHOW_NOTIFICATION,
+    HS_VERB_SHOW_INFORMATION = HS_EVENT_SHOW_INFORMATION,
+    HS_VERB_SUBSCRIBE = HS_EVENT_MAX,
+    HS_VERB_UNSUBSCRIBE,
+    HS_VERB_PING,
+    HS_VERB_GET_RUNNABLES,
+    HS_VERB_GET_TELEMETRY,
+    HS_VERB_BATCH,
+    HS_VERB_GET_STATS,
+    HS_CATALOG_MAX
+};
+
+// every event and verb name, indexed by id
+constexpr const char *hs_catalog[HS_CATALOG_MAX] = {
+    "tap_shortcut",
+    "on_screen_message",
+    "on_screen_reply",
+    "showWindow",
+    "hideWindow",
+    "replyShowWindow",
+    "showNotification",
+    "showInformation",
+    "application-list-changed",
+    "telemetry",
+    "subscribe",
+    "unsubscribe",
+    "ping",
+    "getRunnables",
+    "getTelemetry",
+    "batch",
+    "getStats"
+};
+
+#define HS_CATALOG_HASH_SIZE    64      // power of 2, about 4 slots per name
+
+/*
+ * seeded FNV-1a, the seed is searched at compile time so that every
+ * catalog name lands in its own slot, a lookup is one hash and one strcmp
+ */
+constexpr uint32_t hs_catalog_hash(const char *name, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+    while(*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h & (HS_CATALOG_HASH_SIZE - 1);
+}
+
+constexpr bool hs_catalog_seed_ok(uint32_t seed)
+{
+    bool used[HS_CATALOG_HASH_SIZE] = {};
+    for(int i = 0; i < HS_CATALOG_MAX; ++i) {
+        uint32_t slot = hs_catalog_hash(hs_catalog[i], seed);
+        if(used[slot])
+            return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t hs_catalog_find_seed(void)
+{
+    uint32_t seed = 0;
+    while(!hs_catalog_seed_ok(seed))
+        ++seed;
+    return seed;
+}
+
+constexpr uint32_t HS_CATALOG_SEED = hs_catalog_find_seed();
+
+inline const char* hs_catalog_name(int id)
+{
+    return (id >= 0 && id < HS_CATALOG_MAX) ? hs_catalog[id] : "";
+}
+
+int hs_catalog_lookup(const char *name);
+int hs_catalog_lookup_nocase(const char *name);
+
+#endif // HOMESCREEN_CATALOG_H
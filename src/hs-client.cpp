@@ -26,20 +26,22 @@ static const char _icon[] = "icon";
 static const char _parameter[] = "parameter";
 static const char _replyto[] = "replyto";
 static const char _caller[] = "caller";
+static const char _telemetry[] = "telemetry";
 
-// homescreen-service event and event handler function list
-const std::unordered_map<std::string, HS_Client::func_handler> HS_Client::func_list {
-    {"tap_shortcut",        &HS_Client::tap_shortcut},
-    {"showWindow",          &HS_Client::showWindow},
-    {"hideWindow",          &HS_Client::hideWindow},
-    {"replyShowWindow",     &HS_Client::replyShowWindow},
-    {"on_screen_message",   &HS_Client::on_screen_message},
-    {"on_screen_reply",     &HS_Client::on_screen_reply},
-    {"subscribe",           &HS_Client::subscribe},
-    {"unsubscribe",         &HS_Client::unsubscribe},
-    {"showNotification",    &HS_Client::showNotification},
-    {"showInformation",     &HS_Client::showInformation},
-    {"application-list-changed", nullptr}
+// verb handler function list, indexed by HS_VerbId
+const HS_Client::func_handler HS_Client::func_list[HS_CATALOG_MAX] = {
+    &HS_Client::tap_shortcut,           // HS_VERB_TAP_SHORTCUT
+    &HS_Client::on_screen_message,      // HS_VERB_ON_SCREEN_MESSAGE
+    &HS_Client::on_screen_reply,        // HS_VERB_ON_SCREEN_REPLY
+    &HS_Client::showWindow,             // HS_VERB_SHOW_WINDOW
+    &HS_Client::hideWindow,             // HS_VERB_HIDE_WINDOW
+    &HS_Client::replyShowWindow,        // HS_VERB_REPLY_SHOW_WINDOW
+    &HS_Client::showNotification,       // HS_VERB_SHOW_NOTIFICATION
+    &HS_Client::showInformation,        // HS_VERB_SHOW_INFORMATION
+    nullptr,                            // HS_EVENT_APPLICATION_LIST_CHANGED
+    nullptr,                            // HS_EVENT_TELEMETRY
+    &HS_Client::subscribe,              // HS_VERB_SUBSCRIBE
+    &HS_Client::unsubscribe             // HS_VERB_UNSUBSCRIBE
 };
 
 /**
@@ -52,9 +54,10 @@ const std::unordered_map<std::string, HS_Client::func_handler> HS_Client::func_l
  * None
  *
  */
-HS_Client::HS_Client(afb_req_t request, std::string id) : my_id(id)
+HS_Client::HS_Client(afb_req_t request, std::string id) : my_id(id), created_ns(HS_Telemetry::now())
 {
     my_event = afb_api_make_event(request->api, id.c_str());
+    j_appid = json_object_new_string(id.c_str());
 }
 
 /**
@@ -70,22 +73,23 @@ HS_Client::HS_Client(afb_req_t request, std::string id) : my_id(id)
 HS_Client::~HS_Client()
 {
     afb_event_unref(my_event);
+    json_object_put(j_appid);
 }
 
 /**
  * push tap_shortcut event
  *
  * #### Parameters
- *  - request : the request
+ *  - ctxt : the request context
  *
  * #### Return
  * 0 : success
  * others : fail
  *
  */
-int HS_Client::tap_shortcut(afb_req_t request)
+int HS_Client::tap_shortcut(HS_ReqCtxt &ctxt)
 {
-    (void) request;
+    (void) ctxt;
 
     AFB_INFO("request appid = %s.", my_id.c_str());
     struct json_object* push_obj = json_object_new_object();
@@ -99,17 +103,17 @@ int HS_Client::tap_shortcut(afb_req_t request)
  * push on_screen_message event
  *
  * #### Parameters
- *  - request : the request
+ *  - ctxt : the request context
  *
  * #### Return
  * 0 : success
  * others : fail
  *
  */
-int HS_Client::on_screen_message(afb_req_t request)
+int HS_Client::on_screen_message(HS_ReqCtxt &ctxt)
 {
     int ret = 0;
-    const char* value = afb_req_value(request, _display_message);
+    const char* value = ctxt.value(_display_message);
     if (value) {
         AFB_INFO("push %s event message [%s].", __FUNCTION__, value);
         struct json_object* push_obj = json_object_new_object();
@@ -128,17 +132,17 @@ int HS_Client::on_screen_message(afb_req_t request)
  * push on_screen_reply event
  *
  * #### Parameters
- *  - request : the request
+ *  - ctxt : the request context
  *
  * #### Return
  * 0 : success
  * others : fail
  *
  */
-int HS_Client::on_screen_reply(afb_req_t request)
+int HS_Client::on_screen_reply(HS_ReqCtxt &ctxt)
 {
     int ret = 0;
-    const char* value = afb_req_value(request, _reply_message);
+    const char* value = ctxt.value(_reply_message);
     if (value) {
         AFB_INFO("push %s event message [%s].", __FUNCTION__, value);
         struct json_object* push_obj = json_object_new_object();
@@ -157,27 +161,39 @@ int HS_Client::on_screen_reply(afb_req_t request)
  * subscribe event
  *
  * #### Parameters
- *  - request : the request
+ *  - ctxt : the request context
  *
  * #### Return
  * 0 : success
  * others : fail
  *
  */
-int HS_Client::subscribe(afb_req_t request)
+int HS_Client::subscribe(HS_ReqCtxt &ctxt)
 {
     int ret = 0;
-    const char *value = afb_req_value(request, _event);
+    const char *value = ctxt.value(_event);
     if(value) {
         AFB_INFO("subscribe event %s", value);
-        if(!isSupportEvent(value)) {
+        int event_id = hs_search_event_name_index(value);
+        if(event_id < 0) {
             AFB_WARNING("subscibe event isn't existing.");
             ret = AFB_EVENT_BAD_REQUEST;
         }
         else {
-            event_list.insert(std::string(value));
+            event_list.set(event_id);
+            if(event_id == HS_EVENT_TELEMETRY) {
+                // optional filter, liked {"event":"telemetry", "rate":1, "batteryLev":1}
+                telemetry_filter = HS_TelemetryFilter();
+                struct json_object *args = ctxt.args;
+                if(json_object_is_type(args, json_type_object)) {
+                    json_object_object_foreach(args, key, val) {
+                        if(strcmp(key, _event) != 0 && !telemetry_filter.setOption(key, json_object_get_string(val)))
+                            AFB_WARNING("unknown telemetry option %s", key);
+                    }
+                }
+            }
             if(!subscription) {
-                ret = afb_req_subscribe(request, my_event);
+                ret = afb_req_subscribe(ctxt.request, my_event);
                 if(ret == 0) {
                     subscription = true;
                 }
@@ -195,22 +211,27 @@ int HS_Client::subscribe(afb_req_t request)
  * unsubscribe event
  *
  * #### Parameters
- *  - request : the request
+ *  - ctxt : the request context
  *
  * #### Return
  * 0 : success
  * others : fail
  *
  */
-int HS_Client::unsubscribe(afb_req_t request)
+int HS_Client::unsubscribe(HS_ReqCtxt &ctxt)
 {
     int ret = 0;
-    const char *value = afb_req_value(request, _event);
+    const char *value = ctxt.value(_event);
     if(value) {
         AFB_INFO("unsubscribe %s event", value);
-        event_list.erase(std::string(value));
-        if(event_list.empty()) {
-            ret = afb_req_unsubscribe(request, my_event);
+        int event_id = hs_search_event_name_index(value);
+        if(event_id >= 0)
+            event_list.reset(event_id);
+        if(event_list.none()) {
+            ret = afb_req_unsubscribe(ctxt.request, my_event);
+            if(ret == 0) {
+                subscription = false;
+            }
         }
     }
     else {
@@ -224,21 +245,21 @@ int HS_Client::unsubscribe(afb_req_t request)
  * showWindow event
  *
  * #### Parameters
- * - request : the request
+ * - ctxt : the request context
  *
  * #### Return
  * 0 : success
  * others : fail
  *
  */
-int HS_Client::showWindow(afb_req_t request)
+int HS_Client::showWindow(HS_ReqCtxt &ctxt)
 {
     AFB_INFO("%s application_id = %s.", __FUNCTION__, my_id.c_str());
     int ret = 0;
-    const char* param = afb_req_value(request, _parameter);
+    const char* param = ctxt.value(_parameter);
     if(param) {
-        std::string req_appid = std::move(get_application_id(request));
-        if(req_appid.empty()) {
+        const char *req_appid = ctxt.callerId();
+        if(*req_appid == '\0') {
             AFB_WARNING("can't get application identifier");
             return AFB_REQ_GETAPPLICATIONID_ERROR;
         }
@@ -246,7 +267,7 @@ int HS_Client::showWindow(afb_req_t request)
         struct json_object* push_obj = json_object_new_object();
         hs_add_object_to_json_object_str( push_obj, 4, _application_id, my_id.c_str(), _type, __FUNCTION__);
         struct json_object* param_obj = json_tokener_parse(param);
-        json_object_object_add(param_obj, _replyto, json_object_new_string(req_appid.c_str()));
+        json_object_object_add(param_obj, _replyto, json_object_new_string(req_appid));
         json_object_object_add(push_obj, _parameter, param_obj);
         afb_event_push(my_event, push_obj);
     }
@@ -261,17 +282,17 @@ int HS_Client::showWindow(afb_req_t request)
  * hideWindow event
  *
  * #### Parameters
- * - request : the request
+ * - ctxt : the request context
  *
  * #### Return
  * 0 : success
  * others : fail
  *
  */
-int HS_Client::hideWindow(afb_req_t request)
+int HS_Client::hideWindow(HS_ReqCtxt &ctxt)
 {
-    std::string req_appid = std::move(get_application_id(request));
-    if(req_appid.empty()) {
+    const char *req_appid = ctxt.callerId();
+    if(*req_appid == '\0') {
         AFB_WARNING("can't get application identifier");
         return AFB_REQ_GETAPPLICATIONID_ERROR;
     }
@@ -280,7 +301,7 @@ int HS_Client::hideWindow(afb_req_t request)
     hs_add_object_to_json_object_str( push_obj, 4, _application_id, my_id.c_str(),
     _type, __FUNCTION__);
     struct json_object* param_obj = json_object_new_object();
-    json_object_object_add(param_obj, _caller, json_object_new_string(req_appid.c_str()));
+    json_object_object_add(param_obj, _caller, json_object_new_string(req_appid));
     json_object_object_add(push_obj, _parameter, param_obj);
     afb_event_push(my_event, push_obj);
     return 0;
@@ -290,18 +311,18 @@ int HS_Client::hideWindow(afb_req_t request)
  * replyShowWindow event
  *
  * #### Parameters
- * - request : the request
+ * - ctxt : the request context
  *
  * #### Return
  * 0 : success
  * others : fail
  *
  */
-int HS_Client::replyShowWindow(afb_req_t request)
+int HS_Client::replyShowWindow(HS_ReqCtxt &ctxt)
 {
     AFB_INFO("%s application_id = %s.", __FUNCTION__, my_id.c_str());
     int ret = 0;
-    const char* param = afb_req_value(request, _parameter);
+    const char* param = ctxt.value(_parameter);
     if(param) {
         struct json_object* push_obj = json_object_new_object();
         hs_add_object_to_json_object_str( push_obj, 4, _application_id, my_id.c_str(), _type, __FUNCTION__);
@@ -319,31 +340,31 @@ int HS_Client::replyShowWindow(afb_req_t request)
  * showNotification event
  *
  * #### Parameters
- *  - request : the request
+ *  - ctxt : the request context
  *
  * #### Return
  * 0 : success
  * others : fail
  *
  */
-int HS_Client::showNotification(afb_req_t request)
+int HS_Client::showNotification(HS_ReqCtxt &ctxt)
 {
     int ret = 0;
-    const char *value = afb_req_value(request, _text);
+    const char *value = ctxt.value(_text);
     if(value) {
         AFB_INFO("text is %s", value);
-        std::string appid =std::move(get_application_id(request));
-        if(appid.empty()) {
+        const char *appid = ctxt.callerId();
+        if(*appid == '\0') {
             AFB_WARNING("can't get application identifier");
             return AFB_REQ_GETAPPLICATIONID_ERROR;
         }
 
-        const char *icon = afb_req_value(request, _icon);
+        const char *icon = ctxt.value(_icon);
         if(icon) {
             struct json_object* param_obj = json_object_new_object();
             json_object_object_add(param_obj, _icon, json_object_new_string(icon));
             json_object_object_add(param_obj, _text, json_object_new_string(value));
-            json_object_object_add(param_obj, _caller, json_object_new_string(appid.c_str()));
+            json_object_object_add(param_obj, _caller, json_object_new_string(appid));
             struct json_object* push_obj = json_object_new_object();
             hs_add_object_to_json_object_str( push_obj, 4, _application_id, my_id.c_str(), _type, __FUNCTION__);
             json_object_object_add(push_obj, _parameter, param_obj);
@@ -366,21 +387,21 @@ int HS_Client::showNotification(afb_req_t request)
  * showInformation event
  *
  * #### Parameters
- *  - request : the request
+ *  - ctxt : the request context
  *
  * #### Return
  * 0 : success
  * others : fail
  *
  */
-int HS_Client::showInformation(afb_req_t request)
+int HS_Client::showInformation(HS_ReqCtxt &ctxt)
 {
     int ret = 0;
-    const char *value = afb_req_value(request, _info);
+    const char *value = ctxt.value(_info);
     if(value) {
         AFB_INFO("info is %s", value);
-        std::string appid = std::move(get_application_id(request));
-        if(appid.empty()) {
+        const char *appid = ctxt.callerId();
+        if(*appid == '\0') {
             AFB_WARNING("can't get application identifier");
             return AFB_REQ_GETAPPLICATIONID_ERROR;
         }
@@ -401,93 +422,140 @@ int HS_Client::showInformation(afb_req_t request)
 }
 
 /**
- * check if client subscribe event
+ * handle homescreen event
  *
  * #### Parameters
- *  - event: homescreen event, tap_shortcut etc.
+ *  - ctxt : the request context, with verb id
  *
  * #### Return
- * true: found
- * false: not found
+ * 0: success
+ * others: fail
  *
  */
-bool HS_Client::checkEvent(const char* event)
+int HS_Client::handleRequest(HS_ReqCtxt &ctxt)
 {
-    auto ip = event_list.find(std::string(event));
-    if(ip == event_list.end())
-        return false;
-    else
-        return true;
+    int verb_id = ctxt.verb_id;
+    std::lock_guard<std::mutex> lock(this->mtx);
+    if(verb_id != HS_VERB_SUBSCRIBE && verb_id != HS_VERB_UNSUBSCRIBE && !checkEvent(verb_id))
+        return 0;
+
+    int ret = AFB_EVENT_BAD_REQUEST;
+    func_handler handler = (verb_id >= 0 && verb_id < HS_CATALOG_MAX) ? func_list[verb_id] : nullptr;
+    if(handler != nullptr) {
+        AFB_INFO("[%s]verb found", hs_catalog_name(verb_id));
+        ret = (this->*handler)(ctxt);
+    }
+    return ret;
 }
 
 /**
- * check if event is supporting
+ * push event
  *
  * #### Parameters
- *  - event: homescreen event, tap_shortcut etc.
+ *  - event : the event want to push
+ *  - param : the parameter contents of event, shared or copied, see hs_json_share
  *
  * #### Return
- * true: support
- * false: not fosupportund
+ * 0 : success
+ * others : fail
  *
  */
-bool HS_Client::isSupportEvent(const char* event)
+int HS_Client::pushEvent(const char *event, struct json_object *param)
 {
-    auto ip = func_list.find(std::string(event));
-    if(ip == func_list.end())
-        return false;
-    else
-        return true;
+    int event_id = hs_search_event_name_index(event);
+    if(event_id < 0)
+        return 0;
+
+    struct json_object *j_type = json_object_new_string(event);
+    int ret = pushEvent(event_id, j_type, param);
+    json_object_put(j_type);
+    return ret;
 }
 
 /**
- * handle homescreen event
+ * push event with shared payload, used by broadcast which builds the
+ * type and param objects once for all clients
  *
  * #### Parameters
- *  - request : the request
- *  - verb: request verb name
+ *  - event_id : the event want to push, HS_EventId
+ *  - j_type : event name as json string, shared or copied, see hs_json_share
+ *  - param : the parameter contents of event, shared or copied, see hs_json_share
  *
  * #### Return
- * 0: success
- * others: fail
+ * 0 : success
+ * others : fail
  *
  */
-int HS_Client::handleRequest(afb_req_t request, const char *verb)
+int HS_Client::pushEvent(int event_id, struct json_object *j_type, struct json_object *param)
 {
-    if((strcasecmp(verb, "subscribe") && strcasecmp(verb, "unsubscribe")) && !checkEvent(verb))
+    std::lock_guard<std::mutex> lock(this->mtx);
+    if(!checkEvent(event_id))
         return 0;
 
-    int ret = AFB_EVENT_BAD_REQUEST;
-    auto ip = func_list.find(std::string(verb));
-    if(ip != func_list.end() && ip->second != nullptr) {
-        AFB_INFO("[%s]verb found", verb);
-        ret = (this->*(ip->second))(request);
-    }
-    return ret;
+    AFB_INFO("called, event=%s.", hs_catalog_name(event_id));
+    afb_event_push(my_event, makeEnvelope(j_type, param));
+    return 0;
 }
 
 /**
- * push event
+ * make event envelope. application id, type and param are shared by
+ * reference when json-c reference counts are atomic, copied otherwise,
+ * afb releases the envelope in its job thread (see hs_json_share)
  *
  * #### Parameters
- *  - event : the event want to push
- *  - param : the parameter contents of event
+ *  - j_type : event name as json string, not modified
+ *  - param : the parameter contents of event, not modified
+ *
+ * #### Return
+ * envelope object, owned by caller
+ *
+ */
+struct json_object* HS_Client::makeEnvelope(struct json_object *j_type, struct json_object *param)
+{
+    struct json_object* push_obj = json_object_new_object();
+    json_object_object_add(push_obj, _application_id, hs_json_share(j_appid));
+    json_object_object_add(push_obj, _type, hs_json_share(j_type));
+    if(param != nullptr)
+        json_object_object_add(push_obj, _parameter, hs_json_share(param));
+    return push_obj;
+}
+
+/**
+ * push telemetry event as client's filter decides
+ *
+ * #### Parameters
+ *  - frame : decoded telemetry frame
+ *  - payload : HS_TELEMETRY_PAYLOAD_SLOTS objects shared by all clients,
+ *              slot 0 is full frame of non delta clients, others are
+ *              indexed by mask, last is event type. All are built on
+ *              first use and released by caller
  *
  * #### Return
  * 0 : success
  * others : fail
  *
  */
-int HS_Client::pushEvent(const char *event, struct json_object *param)
+int HS_Client::pushTelemetry(const HS_TelemetryFrame &frame, struct json_object **payload)
 {
-    if(!checkEvent(event))
+    std::lock_guard<std::mutex> lock(this->mtx);
+    if(!checkEvent(HS_EVENT_TELEMETRY))
         return 0;
 
-    AFB_INFO("called, event=%s.",event);
-    struct json_object* push_obj = json_object_new_object();
-    hs_add_object_to_json_object_str( push_obj, 4, _application_id, my_id.c_str(), _type, event);
-    if(param != nullptr)
-        json_object_object_add(push_obj, _parameter, param);
-    afb_event_push(my_event, push_obj);
+    unsigned int mask = telemetry_filter.mask(frame);
+    if(mask == 0)
+        return 0;   // filtered out
+
+    unsigned int slot = telemetry_filter.enabled ? mask : 0;
+    if(payload[slot] == nullptr) {
+        payload[slot] = json_object_new_object();
+        hs_add_telemetry_to_json_object(payload[slot], frame, mask & HS_TELEMETRY_FIELD_ALL);
+        if(slot != 0 && (mask & HS_TELEMETRY_KEYFRAME))
+            json_object_object_add(payload[slot], "keyframe", json_object_new_int(1));
+    }
+
+    if(payload[HS_TELEMETRY_TYPE_SLOT] == nullptr)
+        payload[HS_TELEMETRY_TYPE_SLOT] = json_object_new_string(_telemetry);
+    afb_event_push(my_event, makeEnvelope(payload[HS_TELEMETRY_TYPE_SLOT], payload[slot]));
+    telemetry_filter.sent(frame, mask);
     return 0;
 }
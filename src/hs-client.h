@@ -18,11 +18,14 @@
 #define HOMESCREEN_CLIENT_H
 
 #include <string>
-#include <unordered_set>
-#include <unordered_map>
+#include <mutex>
+#include <bitset>
 #include "hs-helper.h"
 
 
+#define HS_TELEMETRY_TYPE_SLOT      HS_TELEMETRY_MASK_COUNT
+#define HS_TELEMETRY_PAYLOAD_SLOTS  (HS_TELEMETRY_MASK_COUNT + 1)
+
 class HS_Client {
 public:
     HS_Client(afb_req_t request, const char* id) : HS_Client(request, std::string(id)){}
@@ -31,31 +34,39 @@ public:
     HS_Client &operator=(HS_Client&) = delete;
     ~HS_Client();
 
-    int handleRequest(afb_req_t request, const char *verb);
+    int handleRequest(HS_ReqCtxt &ctxt);
     int pushEvent(const char *event, struct json_object *param);
+    int pushEvent(int event_id, struct json_object *j_type, struct json_object *param);
+    int pushTelemetry(const HS_TelemetryFrame &frame, struct json_object **payload);
+    uint64_t createdAt(void) const { return created_ns; }
 
 private:
-    int tap_shortcut(afb_req_t request);
-    int on_screen_message (afb_req_t request);
-    int on_screen_reply (afb_req_t request);
-    int showWindow(afb_req_t request);
-    int hideWindow(afb_req_t request);
-    int replyShowWindow(afb_req_t request);
-    int subscribe(afb_req_t request);
-    int unsubscribe(afb_req_t request);
-    int showNotification(afb_req_t request);
-    int showInformation(afb_req_t request);
-
-    typedef int (HS_Client::*func_handler)(afb_req_t);
-    static const std::unordered_map<std::string, func_handler> func_list;
-    bool checkEvent(const char* event);
-    bool isSupportEvent(const char* event);
+    int tap_shortcut(HS_ReqCtxt &ctxt);
+    int on_screen_message(HS_ReqCtxt &ctxt);
+    int on_screen_reply(HS_ReqCtxt &ctxt);
+    int showWindow(HS_ReqCtxt &ctxt);
+    int hideWindow(HS_ReqCtxt &ctxt);
+    int replyShowWindow(HS_ReqCtxt &ctxt);
+    int subscribe(HS_ReqCtxt &ctxt);
+    int unsubscribe(HS_ReqCtxt &ctxt);
+    int showNotification(HS_ReqCtxt &ctxt);
+    int showInformation(HS_ReqCtxt &ctxt);
+
+    typedef int (HS_Client::*func_handler)(HS_ReqCtxt&);
+    static const func_handler func_list[HS_CATALOG_MAX];
+    bool checkEvent(int event_id) const
+    { return event_id >= 0 && event_id < HS_EVENT_MAX && event_list.test(event_id); }
+    struct json_object* makeEnvelope(struct json_object *j_type, struct json_object *param);
 
 private:
     std::string my_id;
+    uint64_t created_ns;    // CLOCK_MONOTONIC
+    struct json_object *j_appid;    // put in every event envelope, see hs_json_share
     afb_event_t my_event;
     bool subscription = false;
-    std::unordered_set<std::string> event_list;
+    std::bitset<HS_EVENT_MAX> event_list;  // subscribed HS_EventId
+    HS_TelemetryFilter telemetry_filter;
+    std::mutex mtx;     // requests of this client against event pushes
 
 };
 
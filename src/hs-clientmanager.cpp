@@ -15,21 +15,89 @@
  * limitations under the License.
  */
 
+#include <cstdlib>
 #include <cstring>
 #include <algorithm>
 #include <cassert>
 #include "hs-proxy.h"
 #include "hs-clientmanager.h"
+#include "hs-appinfo.h"
+#include "hs-scheduler.h"
+
+#define RUNNERS_INTERVAL_MS 2000    // running application list refresh
 
 static const char _homescreen[] = "homescreen";
+static const char _event[] = "event";
+static const char _topic[] = "topic";
+static const char _type[] = "type";
+static const char _parameter[] = "parameter";
+
+// broadcast events which have a topic event
+static const int topic_list[] = {
+    HS_EVENT_APPLICATION_LIST_CHANGED,
+    HS_EVENT_TELEMETRY
+};
 
 HS_ClientManager* HS_ClientManager::me = nullptr;
 
+// heap buffer of string longer than its small string buffer
+static uint64_t string_allocs(const std::string &s)
+{
+    static const size_t sso = std::string().capacity();
+    return s.size() > sso ? 1 : 0;
+}
+
+// heap allocations of copying registry, see HS_RegistryStats
+static uint64_t copy_allocs(const HS_ClientManager::client_map &map)
+{
+    uint64_t allocs = map.bucket_count() > 1 ? 2 : 1;
+    for(auto &m : map)
+        allocs += 1 + string_allocs(m.first);
+    return allocs;
+}
+
 static void cbRemoveClientCtxt(void *data)
 {
     HS_ClientManager::instance()->removeClientCtxt(data);
 }
 
+static void cbTelemetryFrame(const HS_TelemetryFrame &frame)
+{
+    HS_ClientManager::instance()->pushTelemetry(frame);
+}
+
+// runs in afb job thread, afb calls are not made from scheduler thread
+static void runnersJob(int signum, void *arg)
+{
+    if(signum == 0)
+        static_cast<HS_ClientManager*>(arg)->refreshRunning();
+}
+
+static void runnersTask(void *arg)
+{
+    HS_ClientManager *manager = static_cast<HS_ClientManager*>(arg);
+    if(afb_api_queue_job(manager->getApi(), runnersJob, manager, nullptr, 0) < 0)
+        AFB_WARNING("queue runners job failed.");
+}
+
+struct runners_closure {
+    HS_ClientManager *manager;
+    uint64_t since_ns;
+};
+
+static void cbRunners(void *closure, struct json_object *object, const char *error, const char *info, afb_api_t api)
+{
+    (void)info;
+    (void)api;
+    struct runners_closure *cdata = static_cast<struct runners_closure*>(closure);
+    if(error != nullptr)
+        AFB_WARNING("afm-main runners failed(%s).", error);
+    else
+        cdata->manager->updateRunning(object, cdata->since_ns);
+    cdata->manager->runnersDone();
+    delete cdata;
+}
+
 /**
  * HS_ClientManager construction function
  *
@@ -41,6 +109,7 @@ static void cbRemoveClientCtxt(void *data)
  *
  */
 HS_ClientManager::HS_ClientManager()
+    : client_list(std::make_shared<const client_map>())
 {
 }
 
@@ -66,15 +135,23 @@ HS_ClientManager* HS_ClientManager::instance(void)
  * HS_ClientManager init function
  *
  * #### Parameters
- *  - Nothing
+ *  - api : the api serving the request
  *
  * #### Return
  * init result
  *
  */
-int HS_ClientManager::init(void)
+int HS_ClientManager::init(afb_api_t api)
 {
-    return 0;
+    this->api = api;
+    HS_Scheduler::instance()->addTask("runners", runnersTask, this, 0, RUNNERS_INTERVAL_MS);
+
+    for(int id : topic_list) {
+        topic_event[id] = afb_api_make_event(api, hs_catalog_name(id));
+        if(topic_event[id] == nullptr)
+            AFB_WARNING("make topic event %s failed.", hs_catalog_name(id));
+    }
+    return HS_Telemetry::instance()->addListener(cbTelemetryFrame);
 }
 
 /**
@@ -93,11 +170,19 @@ HS_ClientCtxt* HS_ClientManager::createClientCtxt(afb_req_t req, std::string app
     if (!ctxt)
     {
         AFB_INFO( "create new session for %s", appid.c_str());
-        ctxt = new HS_ClientCtxt(appid);
+        ctxt = ctxt_pool.create<HS_ClientCtxt>(appid);
         afb_req_session_set_LOA(req, 1);
         afb_req_context_set(req, ctxt, cbRemoveClientCtxt);
 
+        // context id, appid2ctxt node and key, bucket array on rehash
+        size_t buckets = appid2ctxt.bucket_count();
+        size_t size = appid2ctxt.size();
 	appid2ctxt[appid] = ctxt;
+        registry_stats.heap_allocs += string_allocs(appid);
+        if(appid2ctxt.size() != size)
+            registry_stats.heap_allocs += 1 + string_allocs(appid);
+        if(appid2ctxt.bucket_count() != buckets)
+            ++registry_stats.heap_allocs;
     }
 
     return ctxt;
@@ -113,13 +198,15 @@ HS_ClientCtxt* HS_ClientManager::createClientCtxt(afb_req_t req, std::string app
  * HS_Client pointer
  *
  */
-HS_Client* HS_ClientManager::addClient(afb_req_t req, std::string appid)
+std::shared_ptr<HS_Client> HS_ClientManager::addClient(afb_req_t req, std::string appid)
 {
-    return (client_list[appid] = new HS_Client(req, appid));
+    std::lock_guard<HS_Mutex> lock(this->mtx);
+    return insertClient(req, appid);
 }
 
 /**
- * remove Client
+ * remove Client. The client is released when the last snapshot holding
+ * it is gone.
  *
  * #### Parameters
  *  - appid: app's id
@@ -130,8 +217,133 @@ HS_Client* HS_ClientManager::addClient(afb_req_t req, std::string appid)
  */
 void HS_ClientManager::removeClient(std::string appid)
 {
-    delete client_list[appid];
-    client_list.erase(appid);
+    std::lock_guard<HS_Mutex> lock(this->mtx);
+    eraseClient(appid);
+}
+
+/**
+ * remove Client if it is still the one handle refers to, an appid may be
+ * added again meanwhile
+ *
+ * #### Parameters
+ *  - appid: app's id
+ *  - handle: handle from getClientHandle
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_ClientManager::removeClient(std::string appid, HS_PoolHandle handle)
+{
+    std::lock_guard<HS_Mutex> lock(this->mtx);
+    auto clients = getClients();
+    auto ip = clients->find(appid);
+    if(ip != clients->end() && client_pool.handleOf(ip->second.get()) == handle)
+        eraseClient(appid);
+}
+
+/**
+ * get stable handle of client
+ *
+ * #### Parameters
+ *  - client: the client
+ *
+ * #### Return
+ * handle
+ *
+ */
+HS_PoolHandle HS_ClientManager::getClientHandle(const HS_Client *client) const
+{
+    return client_pool.handleOf(client);
+}
+
+/**
+ * get pool statistics of client objects
+ *
+ * #### Parameters
+ *  - clients : [OUT] HS_Client pool statistics
+ *  - ctxts : [OUT] HS_ClientCtxt pool statistics
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_ClientManager::getPoolStats(HS_PoolStats *clients, HS_PoolStats *ctxts) const
+{
+    client_pool.getStats(clients);
+    ctxt_pool.getStats(ctxts);
+}
+
+/**
+ * get heap allocation counters of client add/remove path
+ *
+ * #### Parameters
+ *  - stats : [OUT] statistics
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_ClientManager::getRegistryStats(HS_RegistryStats *stats)
+{
+    std::lock_guard<HS_Mutex> lock(this->mtx);
+    *stats = registry_stats;
+}
+
+/**
+ * publish a copy of registry with new client, called with mtx locked.
+ * the client and its control block take a pool slot, the map copy and
+ * the client's own members are allocated from heap and counted in
+ * registry_stats
+ *
+ * #### Parameters
+ *  - req : the request
+ *  - appid : app's id
+ *
+ * #### Return
+ * HS_Client pointer
+ *
+ */
+std::shared_ptr<HS_Client> HS_ClientManager::insertClient(afb_req_t req, const std::string &appid)
+{
+    auto client = std::allocate_shared<HS_Client>(HS_PoolAllocator<HS_Client>(&client_pool), req, appid);
+    auto current = std::atomic_load(&client_list);
+    auto list = std::make_shared<client_map>(*current);
+    size_t buckets = list->bucket_count();
+    (*list)[appid] = client;
+    // afb event, j_appid and my_id of client, copy, new node and key,
+    // bucket array on rehash
+    registry_stats.heap_allocs += 2 + string_allocs(appid) + copy_allocs(*current) + 1 + string_allocs(appid);
+    if(list->bucket_count() != buckets)
+        ++registry_stats.heap_allocs;
+    std::atomic_store(&client_list, std::shared_ptr<const client_map>(std::move(list)));
+    ++registry_stats.adds;
+    return client;
+}
+
+/**
+ * publish a copy of registry without client, called with mtx locked
+ *
+ * #### Parameters
+ *  - appid : app's id
+ *  - expected : remove only this client, nullptr : any client of appid
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_ClientManager::eraseClient(const std::string &appid, const HS_Client *expected)
+{
+    auto current = std::atomic_load(&client_list);
+    auto ip = current->find(appid);
+    if(ip == current->end() || (expected != nullptr && ip->second.get() != expected))
+        return;
+
+    auto list = std::make_shared<client_map>(*current);
+    list->erase(appid);
+    std::atomic_store(&client_list, std::shared_ptr<const client_map>(std::move(list)));
+    registry_stats.heap_allocs += copy_allocs(*current);
+    ++registry_stats.removes;
 }
 
 /**
@@ -154,47 +366,50 @@ void HS_ClientManager::removeClientCtxt(void *data)
     }
 
     AFB_INFO( "remove app %s", ctxt->id.c_str());
-    std::lock_guard<std::mutex> lock(this->mtx);
-    removeClient(ctxt->id);
-    delete appid2ctxt[ctxt->id];
-    appid2ctxt.erase(ctxt->id);
+    std::lock_guard<HS_Mutex> lock(this->mtx);
+    // a newer session of the app may own the appid meanwhile
+    auto ip = appid2ctxt.find(ctxt->id);
+    if(ip != appid2ctxt.end() && ip->second == ctxt) {
+        eraseClient(ctxt->id);
+        appid2ctxt.erase(ip);
+    }
+    ctxt_pool.destroy(ctxt);
 }
 
+/**
+ * check if application of client is running, never blocks.
+ * the running set is refreshed in background by async afm-main runners
+ * calls, a client added after the running set was requested is taken as
+ * running since it may be starting, so is a client which isn't a runnable.
+ *
+ * #### Parameters
+ *  - appid : app's id
+ *  - client : client of the app
+ *  - running : running set, nullptr : not known yet
+ *
+ * #### Return
+ * 0 : running
+ * AFB_REQ_NOT_STARTED_APPLICATION : not running
+ *
+ */
 static int
-is_application_running(std::string appid, std::unordered_map<std::string, HS_Client*> client_list)
+is_application_running(const std::string &appid, const HS_Client &client,
+                       const HS_ClientManager::RunningSet *running)
 {
-    bool app_still_running = false;
-
-    std::string id(appid);
-    auto ip = client_list.find(id);
-
-    // this will always be case as the removeClientCtxt() is never called as
-    // clients do not handle the subscribe at all at this point. Not only that
-    // but is redudant but we keep at as it to highlight the fact that we're
-    // missing a feature to check if applications died or not (legitimate or not).
-    //
-    // Using ps (HS_AfmMainProxy::ps -- a sync version of checking if running
-    // applications) seem to block in afm-system-daemon (see SPEC-3902), and
-    // doing w/ it with an async version of ps doesn't work because we don't
-    // have a valid clientCtx (required, and only possible if the application
-    // subscribed themselves, which no longer happens)
-    //
-    // FIXME: We need another way of handling this would be necessary to correctly
-    // handle the case where the app died.
-    if (ip != client_list.end()) {
-        app_still_running = true;
-    }
+    if(running == nullptr
+       || client.createdAt() >= running->since_ns
+       || running->appids.find(appid) != running->appids.end()
+       || HS_AppInfo::instance()->checkAppId(appid).empty())   // not started by afm-main
+        return 0;
 
-    // > 0 means err
-    return app_still_running != true;
+    return AFB_REQ_NOT_STARTED_APPLICATION;
 }
 
 /**
  * handle homescreen request
  *
  * #### Parameters
- *  - request : the request
- *  - verb : the verb name
+ *  - ctxt : the request context
  *  - appid : to which application
  *
  * #### Return
@@ -202,41 +417,62 @@ is_application_running(std::string appid, std::unordered_map<std::string, HS_Cli
  * others : fail
  *
  */
-int HS_ClientManager::handleRequest(afb_req_t request, const char *verb, const char *appid)
+int HS_ClientManager::handleRequest(HS_ReqCtxt &ctxt, const char *appid)
 {
-    AFB_INFO("verb=[%s],appid=[%s].", verb, appid);
+    int verb_id = ctxt.verb_id;
+    AFB_INFO("verb=[%s],appid=[%s].", hs_catalog_name(verb_id), appid);
+    bool subscribe = verb_id == HS_VERB_SUBSCRIBE;
+    if(subscribe || verb_id == HS_VERB_UNSUBSCRIBE) {
+        const char *topic = ctxt.value(_topic);
+        if(topic != nullptr && atoi(topic) != 0)
+            return subscribeTopic(ctxt, subscribe);
+    }
+
     int ret = 0;
-    std::lock_guard<std::mutex> lock(this->mtx);
+    auto clients = getClients();
     if(appid == nullptr) {
-        for(auto m : client_list) {
-            m.second->handleRequest(request, verb);
+        for(auto &m : *clients) {
+            m.second->handleRequest(ctxt);
         }
     }
     else {
         std::string id(appid);
-        auto ip = client_list.find(id);
-	if(ip != client_list.end()) {
+        auto ip = clients->find(id);
+	if(ip != clients->end()) {
 	    // for showWindow verb we need to verify if the app is (still)
 	    // running, and return the appropriate value to attempt to start it
 	    // again. This 'problem' is avoided if the application itself
 	    // subscribes and with that process, to install a callback that
 	    // automatically removes the application from client_list.
 	    // That is exactly how "subscribe" verb is handled below.
-            if (strcasecmp(verb, "showWindow") == 0) {
-                ret = is_application_running(id, client_list);
+            if (verb_id == HS_VERB_SHOW_WINDOW) {
+                auto running = std::atomic_load(&running_list);
+                ret = is_application_running(id, *ip->second, running.get());
                 if (ret == AFB_REQ_NOT_STARTED_APPLICATION) {
                     AFB_INFO("%s is not running. Will attempt to start it", appid);
                     return ret;
                 }
             }
             AFB_INFO("%s found to be running. Forwarding request to the client", appid);
-            ret = ip->second->handleRequest(request, verb);
+            ret = ip->second->handleRequest(ctxt);
         }
         else {
-            if(!strcasecmp(verb, "subscribe")) {
-                createClientCtxt(request, id);
-                HS_Client* client = addClient(request, id);
-                ret = client->handleRequest(request, "subscribe");
+            if(subscribe) {
+                std::shared_ptr<HS_Client> client;
+                {
+                    std::lock_guard<HS_Mutex> lock(this->mtx);
+                    // another request of the app may have added it meanwhile
+                    auto current = getClients();
+                    auto found = current->find(id);
+                    if(found != current->end()) {
+                        client = found->second;
+                    }
+                    else {
+                        createClientCtxt(ctxt.request, id);
+                        client = insertClient(ctxt.request, id);
+                    }
+                }
+                ret = client->handleRequest(ctxt);
             }
             else {
                 AFB_NOTICE("not exist session");
@@ -252,7 +488,7 @@ int HS_ClientManager::handleRequest(afb_req_t request, const char *verb, const c
  *
  * #### Parameters
  *  - event : the event want to push
- *  - param : the parameter contents of event
+ *  - param : the parameter contents of event, ownership is taken
  *  - appid : the destination application's id
  *
  * #### Return
@@ -264,21 +500,209 @@ int HS_ClientManager::pushEvent(const char *event, struct json_object *param, st
 {
     if(event == nullptr) {
         AFB_WARNING("event name is null.");
+        if(param != nullptr)
+            json_object_put(param);
         return -1;
     }
 
-    std::lock_guard<std::mutex> lock(this->mtx);
+    auto clients = getClients();
     if(appid.empty()) { // broadcast event to clients who subscribed this event
-        for(auto m : client_list) {
-            m.second->pushEvent(event, param);
+        int event_id = hs_search_event_name_index(event);
+        if(event_id >= 0) {
+            struct json_object *j_type = json_object_new_string(event);    // built once for all envelopes
+            for(auto &m : *clients) {
+                m.second->pushEvent(event_id, j_type, param);
+            }
+            pushTopic(event_id, j_type, param);
+            json_object_put(j_type);
+        }
+        else {
+            AFB_WARNING("%s isn't a homescreen event.", event);
         }
     }
     else {  // push event to specific client
-        auto ip = client_list.find(appid);
-        if(ip != client_list.end()) {
+        auto ip = clients->find(appid);
+        if(ip != clients->end()) {
             ip->second->pushEvent(event, param);
         }
     }
 
+    // every client took its own reference
+    if(param != nullptr)
+        json_object_put(param);
     return 0;
 }
+
+/**
+ * push telemetry event to subscribed clients, called in serial reader thread.
+ * every client gets what its filter decides, every payload is built once
+ * per field mask and shared by all clients which need it.
+ *
+ * #### Parameters
+ *  - frame : decoded telemetry frame
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_ClientManager::pushTelemetry(const HS_TelemetryFrame &frame)
+{
+    struct json_object *payload[HS_TELEMETRY_PAYLOAD_SLOTS] = {};
+    auto clients = getClients();
+    for(auto &m : *clients)
+        m.second->pushTelemetry(frame, payload);
+
+    // topic subscribers get every full frame
+    if(topic_event[HS_EVENT_TELEMETRY] != nullptr
+       && topic_subscribers[HS_EVENT_TELEMETRY].load(std::memory_order_relaxed) != 0) {
+        if(payload[0] == nullptr) {
+            payload[0] = json_object_new_object();
+            hs_add_telemetry_to_json_object(payload[0], frame);
+        }
+        if(payload[HS_TELEMETRY_TYPE_SLOT] == nullptr)
+            payload[HS_TELEMETRY_TYPE_SLOT] = json_object_new_string(hs_catalog_name(HS_EVENT_TELEMETRY));
+        pushTopic(HS_EVENT_TELEMETRY, payload[HS_TELEMETRY_TYPE_SLOT], payload[0]);
+    }
+
+    for(int i = 0; i < HS_TELEMETRY_PAYLOAD_SLOTS; ++i) {
+        if(payload[i] != nullptr)
+            json_object_put(payload[i]);
+    }
+}
+
+/**
+ * subscribe or unsubscribe topic event, liked {"event":"application-list-changed", "topic":1}
+ *
+ * #### Parameters
+ *  - ctxt : the request context
+ *  - subscribe : true : subscribe, false : unsubscribe
+ *
+ * #### Return
+ * 0 : success
+ * others : fail
+ *
+ */
+int HS_ClientManager::subscribeTopic(HS_ReqCtxt &ctxt, bool subscribe)
+{
+    const char *value = ctxt.value(_event);
+    if(value == nullptr) {
+        AFB_WARNING("Please input event name");
+        return AFB_EVENT_BAD_REQUEST;
+    }
+
+    int event_id = hs_search_event_name_index(value);
+    if(event_id < 0 || topic_event[event_id] == nullptr) {
+        AFB_WARNING("%s has no topic event.", value);
+        return AFB_EVENT_BAD_REQUEST;
+    }
+
+    AFB_INFO("%s topic %s", subscribe ? "subscribe" : "unsubscribe", value);
+    int ret;
+    if(subscribe) {
+        ret = afb_req_subscribe(ctxt.request, topic_event[event_id]);
+        if(ret == 0)
+            topic_subscribers[event_id].fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        ret = afb_req_unsubscribe(ctxt.request, topic_event[event_id]);
+        // may race with a reset, too high a count costs one push only
+        if(ret == 0 && topic_subscribers[event_id].load(std::memory_order_relaxed) > 0)
+            topic_subscribers[event_id].fetch_sub(1, std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+/**
+ * push event to topic subscribers, one push for all of them, nothing is
+ * built while the topic has no subscriber
+ *
+ * #### Parameters
+ *  - event_id : the event, HS_EventId
+ *  - j_type : event name as json string, shared or copied, see hs_json_share
+ *  - param : the parameter contents of event, shared or copied, see hs_json_share
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_ClientManager::pushTopic(int event_id, struct json_object *j_type, struct json_object *param)
+{
+    unsigned int subscribers = topic_subscribers[event_id].load(std::memory_order_relaxed);
+    if(topic_event[event_id] == nullptr || subscribers == 0)
+        return;
+
+    struct json_object *push_obj = json_object_new_object();
+    json_object_object_add(push_obj, _type, hs_json_share(j_type));
+    if(param != nullptr)
+        json_object_object_add(push_obj, _parameter, hs_json_share(param));
+    // every subscriber is gone unless one subscribed meanwhile
+    if(afb_event_push(topic_event[event_id], push_obj) == 0)
+        topic_subscribers[event_id].compare_exchange_strong(subscribers, 0, std::memory_order_relaxed);
+}
+
+/**
+ * request running application list from afm-main asynchronously,
+ * at most one request is pending
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_ClientManager::refreshRunning(void)
+{
+    if(runners_pending.exchange(true))
+        return;
+
+    struct runners_closure *cdata = new runners_closure;
+    cdata->manager = this;
+    cdata->since_ns = HS_Telemetry::now();
+    afmmain.ps(api, cbRunners, cdata);
+}
+
+/**
+ * replace running set with afm-main runners reply and evict clients of
+ * runnable applications which are not running anymore
+ *
+ * #### Parameters
+ *  - object : runners reply, json array
+ *  - since_ns : time the request was sent
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_ClientManager::updateRunning(struct json_object *object, uint64_t since_ns)
+{
+    if(json_object_get_type(object) != json_type_array) {
+        AFB_WARNING("afm-main runners reply isn't array.");
+        return;
+    }
+
+    auto running = std::make_shared<RunningSet>();
+    running->since_ns = since_ns;
+    int array_len = json_object_array_length(object);
+    for(int i = 0; i < array_len; ++i) {
+        struct json_object *j_id;
+        if(json_object_object_get_ex(json_object_array_get_idx(object, i), _keyId, &j_id)) {
+            std::string id = json_object_get_string(j_id);
+            running->appids.insert(id.substr(0, id.find('@')));
+        }
+    }
+    std::atomic_store(&running_list, std::shared_ptr<const RunningSet>(running));
+
+    // clients added after request may be starting, keep them
+    auto clients = getClients();
+    for(auto &m : *clients) {
+        if(m.second->createdAt() >= since_ns
+           || running->appids.find(m.first) != running->appids.end()
+           || HS_AppInfo::instance()->checkAppId(m.first).empty())
+            continue;
+
+        AFB_NOTICE("%s isn't running, remove client.", m.first.c_str());
+        std::lock_guard<HS_Mutex> lock(this->mtx);
+        eraseClient(m.first, m.second.get());
+    }
+}
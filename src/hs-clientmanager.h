@@ -21,9 +21,28 @@
 #include <string>
 #include <mutex>
 #include <memory>
+#include <atomic>
 #include <unordered_map>
+#include <unordered_set>
 #include "hs-helper.h"
 #include "hs-client.h"
+#include "hs-proxy.h"
+#include "hs-pool.h"
+#include "hs-telemetry.h"
+#include "hs-stats.h"
+
+// HS_Client and its shared_ptr control block share one pool slot
+#define HS_CLIENT_POOL_SLOT     (sizeof(HS_Client) + 64)
+
+// client add/remove path, heap allocations besides the pool slots.
+// every add or remove copies the registry, the copy of N clients
+// allocates the map with its control block, the bucket array, N nodes
+// and the keys longer than the small string buffer
+struct HS_RegistryStats {
+    uint64_t adds;          // clients added
+    uint64_t removes;       // clients removed
+    uint64_t heap_allocs;   // registry copies, client members, session contexts
+};
 
 struct HS_ClientCtxt {
     std::string id;
@@ -44,20 +63,61 @@ public:
     HS_ClientManager &operator=(HS_ClientManager &&) = delete;
 
     static HS_ClientManager* instance(void);
-    int init(void);
-    int handleRequest(afb_req_t request, const char *verb, const char *appid = nullptr);
+    int init(afb_api_t api);
+    int handleRequest(HS_ReqCtxt &ctxt, const char *appid = nullptr);
     int pushEvent(const char *event, struct json_object *param, std::string appid = "");
+    void pushTelemetry(const HS_TelemetryFrame &frame);
     void removeClientCtxt(void *data);  // don't use, internal only
 
     HS_ClientCtxt* createClientCtxt(afb_req_t req, std::string appid);
-    HS_Client* addClient(afb_req_t req, std::string appid);
+    std::shared_ptr<HS_Client> addClient(afb_req_t req, std::string appid);
     void removeClient(std::string appid);
+    void removeClient(std::string appid, HS_PoolHandle handle);
+    HS_PoolHandle getClientHandle(const HS_Client *client) const;
+    void getPoolStats(HS_PoolStats *clients, HS_PoolStats *ctxts) const;
+    void getRegistryStats(HS_RegistryStats *stats);
+
+    typedef std::unordered_map<std::string, std::shared_ptr<HS_Client>> client_map;
+    std::shared_ptr<const client_map> getClients(void) const { return std::atomic_load(&client_list); }
+
+    // running applications as afm-main reported at since_ns
+    struct RunningSet {
+        uint64_t since_ns;
+        std::unordered_set<std::string> appids;
+    };
+    afb_api_t getApi(void) const { return api; }
+    void refreshRunning(void);
+    void updateRunning(struct json_object *object, uint64_t since_ns);
+    void runnersDone(void) { runners_pending = false; }
+
+private:
+    std::shared_ptr<HS_Client> insertClient(afb_req_t req, const std::string &appid);
+    void eraseClient(const std::string &appid, const HS_Client *expected = nullptr);
+    int subscribeTopic(HS_ReqCtxt &ctxt, bool subscribe);
+    void pushTopic(int event_id, struct json_object *j_type, struct json_object *param);
 
 private:
     static HS_ClientManager* me;
-    std::unordered_map<std::string, HS_Client*> client_list;
+    // declared first, objects in pools are released before pools
+    HS_SlabPool client_pool {HS_CLIENT_POOL_SLOT};
+    HS_SlabPool ctxt_pool {sizeof(HS_ClientCtxt)};
+    // one afb event per broadcast event type, subscribed by clients
+    // directly with "topic", afb fans out and serializes once
+    afb_event_t topic_event[HS_EVENT_MAX] = {};
+    // topic subscribes less unsubscribes, reset when afb reports that nobody
+    // listens anymore (sessions closed), 0 : topic payload isn't built
+    std::atomic<unsigned int> topic_subscribers[HS_EVENT_MAX] = {};
+    // read-copy-update registry, readers take a snapshot without lock,
+    // writers copy the map under mtx and publish the copy
+    std::shared_ptr<const client_map> client_list;
     std::unordered_map<std::string, HS_ClientCtxt*> appid2ctxt;
-    std::mutex mtx;
+    HS_Mutex mtx {"clientmanager"};     // serializes registry writers only
+    HS_RegistryStats registry_stats = {};   // updated with mtx locked
+
+    afb_api_t api = nullptr;
+    HS_AfmMainProxy afmmain;
+    std::shared_ptr<const RunningSet> running_list;     // nullptr : not known yet
+    std::atomic<bool> runners_pending {false};
 };
 
 #endif // HOMESCREEN_CLIENTMANAGER_H
@@ -19,24 +19,11 @@
 #include "hs-helper.h"
 
 
-const char* evlist[] = {
-    "tap_shortcut",
-    "on_screen_message",
-    "on_screen_reply",
-    "showWindow",
-    "hideWindow",
-    "replyShowWindow",
-    "showNotification",
-    "showInformation",
-    "application-list-changed",
-    "reserved"
-  };
-
 /**
  * get uint16 value from source
  *
  * #### Parameters
- * - request : Describes the request by bindings from afb-daemon
+ * - ctxt    : the request context
  * - source  : input source
  * - out_id  : output uint16 value
  *
@@ -44,10 +31,10 @@ const char* evlist[] = {
  * error code
  *
  */
-REQ_ERROR get_value_uint16(const afb_req_t request, const char *source, uint16_t *out_id)
+REQ_ERROR get_value_uint16(HS_ReqCtxt &ctxt, const char *source, uint16_t *out_id)
 {
     char* endptr;
-    const char* tmp = afb_req_value (request, source);
+    const char* tmp = ctxt.value(source);
     if(!tmp)
     {
         return REQ_FAIL;
@@ -72,7 +59,7 @@ REQ_ERROR get_value_uint16(const afb_req_t request, const char *source, uint16_t
  * get int16 value from source
  *
  * #### Parameters
- * - request : Describes the request by bindings from afb-daemon
+ * - ctxt    : the request context
  * - source  : input source
  * - out_id  : output int16 value
  *
@@ -80,10 +67,10 @@ REQ_ERROR get_value_uint16(const afb_req_t request, const char *source, uint16_t
  * error code
  *
  */
-REQ_ERROR get_value_int16(const afb_req_t request, const char *source, int16_t *out_id)
+REQ_ERROR get_value_int16(HS_ReqCtxt &ctxt, const char *source, int16_t *out_id)
 {
     char* endptr;
-    const char* tmp = afb_req_value (request, source);
+    const char* tmp = ctxt.value(source);
     if(!tmp)
     {
         return REQ_FAIL;
@@ -108,7 +95,7 @@ REQ_ERROR get_value_int16(const afb_req_t request, const char *source, int16_t *
  * get int32 value from source
  *
  * #### Parameters
- * - request : Describes the request by bindings from afb-daemon
+ * - ctxt    : the request context
  * - source  : input source
  * - out_id  : output int32 value
  *
@@ -116,10 +103,10 @@ REQ_ERROR get_value_int16(const afb_req_t request, const char *source, int16_t *
  * error code
  *
  */
-REQ_ERROR get_value_int32(const afb_req_t request, const char *source, int32_t *out_id)
+REQ_ERROR get_value_int32(HS_ReqCtxt &ctxt, const char *source, int32_t *out_id)
 {
     char* endptr;
-    const char* tmp = afb_req_value (request, source);
+    const char* tmp = ctxt.value(source);
     if(!tmp)
     {
         return REQ_FAIL;
@@ -222,6 +209,35 @@ void hs_add_object_to_json_object_func(struct json_object* j_obj, const char* ve
     va_end(args);
 }
 
+/**
+ * add telemetry frame fields to json object
+ *
+ * #### Parameters
+ * - j_obj : the json object will join in frame fields
+ * - frame : decoded telemetry frame
+ * - mask : HS_TELEMETRY_FIELD_* of fields to add, seq and source are always added
+ *
+ * #### Return
+ * None
+ *
+ */
+void hs_add_telemetry_to_json_object(struct json_object* j_obj, const HS_TelemetryFrame &frame, unsigned int mask)
+{
+    if(mask & HS_TELEMETRY_FIELD_ODO)
+        json_object_object_add(j_obj, "odo", json_object_new_int(frame.odo));
+    if(mask & HS_TELEMETRY_FIELD_CUR_SPEED)
+        json_object_object_add(j_obj, "curSpeed", json_object_new_int(frame.curSpeed));
+    if(mask & HS_TELEMETRY_FIELD_BATTERY_LEV)
+        json_object_object_add(j_obj, "batteryLev", json_object_new_int(frame.batteryLev));
+    if(mask & HS_TELEMETRY_FIELD_SIGNAL_LIGHT_LEFT)
+        json_object_object_add(j_obj, "signalLightLeft", json_object_new_int(frame.signalLightLeft));
+    if(mask & HS_TELEMETRY_FIELD_SIGNAL_LIGHT_RIGHT)
+        json_object_object_add(j_obj, "signalLightRight", json_object_new_int(frame.signalLightRight));
+    hs_add_object_to_json_object(j_obj, 4,
+        "seq", frame.seq,
+        "source", frame.source);
+}
+
 /**
  * search event position in event list
  *
@@ -229,46 +245,125 @@ void hs_add_object_to_json_object_func(struct json_object* j_obj, const char* ve
  * - value : searched event name
  *
  * #### Return
- * event's index in event list
+ * event's index in event list, HS_EventId
+ * -1 : not a homescreen event
  *
  */
 int hs_search_event_name_index(const char* value)
 {
-    size_t buf_size = 50;
-    size_t size = sizeof evlist / sizeof *evlist;
-    int ret = -1;
-    for(size_t i = 0 ; i < size ; ++i)
-    {
-        if(!strncmp(value, evlist[i], buf_size))
-        {
-            ret = i;
-            break;
-        }
-    }
-    return ret;
+    int id = hs_catalog_lookup(value);
+    return id < HS_EVENT_MAX ? id : -1;
+}
+
+/**
+ * get object to put in an event envelope which afb releases in its job
+ * thread while other envelopes are still built from the same object.
+ * json-c reference counts are atomic only when json-c is built with
+ * threading support, which the build requires (HS_JSONC_THREADING),
+ * a copy is returned only when it is turned off.
+ *
+ * #### Parameters
+ * - obj : object shared by several envelopes
+ *
+ * #### Return
+ * obj with a reference taken, or a copy of obj
+ *
+ */
+struct json_object* hs_json_share(struct json_object *obj)
+{
+#ifdef HS_JSONC_THREADING
+    return json_object_get(obj);
+#else
+    struct json_object *copy = nullptr;
+    if(obj != nullptr && json_object_deep_copy(obj, &copy, nullptr) != 0)
+        AFB_WARNING("copy of event object failed.");
+    return copy;
+#endif
+}
+
+/**
+ * make {"verb":name, "error":error} reply of verb
+ *
+ * #### Parameters
+ * - verb_id : the verb, HS_VerbId
+ * - error : error value of reply
+ *
+ * #### Return
+ * reply object, the caller owns it
+ *
+ */
+struct json_object* hs_reply_object(int verb_id, int error)
+{
+    struct json_object *res = json_object_new_object();
+    hs_add_object_to_json_object_func(res, hs_catalog_name(verb_id), 2, _error, error);
+    return res;
 }
 
 /**
- * get application id from request
+ * HS_ReqCtxt construction function
  *
  * #### Parameters
  * - request : the request
+ * - verb_id : the verb, HS_VerbId
+ * - args : batch entry arguments, nullptr : arguments of request
  *
  * #### Return
- * got application id
+ * None
  *
  */
-std::string get_application_id(const afb_req_t request)
+HS_ReqCtxt::HS_ReqCtxt(afb_req_t request, int verb_id, struct json_object *args)
+    : request(request), verb_id(verb_id), args(args != nullptr ? args : afb_req_json(request))
 {
-    std::string appid;
-    char *app_id = afb_req_get_application_id(request);
-    if(app_id == nullptr) {
-        appid = std::string("");
-    }
-    else {
-        appid = std::string(app_id);
-        free(app_id);
-    }
+}
+
+/**
+ * HS_ReqCtxt destruction function
+ *
+ * #### Parameters
+ * - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_ReqCtxt::~HS_ReqCtxt()
+{
+    free(caller);
+}
+
+/**
+ * get request argument
+ *
+ * #### Parameters
+ * - key : argument name
+ *
+ * #### Return
+ * argument value, nullptr : not found
+ *
+ */
+const char* HS_ReqCtxt::value(const char *key) const
+{
+    struct json_object *value;
+    if(!json_object_object_get_ex(args, key, &value))
+        return nullptr;
+    return json_object_get_string(value);
+}
 
-    return appid;
+/**
+ * get application id of caller, asked to afb only once per request
+ *
+ * #### Parameters
+ * - Nothing
+ *
+ * #### Return
+ * caller application id, "" : unknown
+ *
+ */
+const char* HS_ReqCtxt::callerId(void)
+{
+    if(!caller_resolved) {
+        caller = afb_req_get_application_id(request);
+        caller_resolved = true;
+    }
+    return caller != nullptr ? caller : "";
 }
@@ -20,6 +20,8 @@
 #include <afb/afb-binding.h>
 #include <json-c/json.h>
 #include <string>
+#include "hs-telemetry.h"
+#include "hs-catalog.h"
 
 #define AFB_EVENT_BAD_REQUEST                 100
 #define AFB_REQ_SUBSCRIBE_ERROR               101
@@ -37,7 +39,6 @@ typedef enum REQ_ERROR
   OUT_RANGE
 }REQ_ERROR;
 
-extern const char* evlist[];
 extern const char _error[];
 extern const char _application_id[];
 extern const char _display_message[];
@@ -45,14 +46,40 @@ extern const char _reply_message[];
 extern const char _keyData[];
 extern const char _keyId[];
 
-REQ_ERROR get_value_uint16(const afb_req_t request, const char *source, uint16_t *out_id);
-REQ_ERROR get_value_int16(const afb_req_t request, const char *source, int16_t *out_id);
-REQ_ERROR get_value_int32(const afb_req_t request, const char *source, int32_t *out_id);
+/*
+ * one homescreen request, decoded once at verb entry and passed down
+ * through HS_ClientManager and HS_Client. a batch entry has its own
+ * context over the same afb request with the entry arguments.
+ */
+struct HS_ReqCtxt {
+    afb_req_t request;
+    int verb_id;                    // HS_VerbId
+    struct json_object *args;       // request or batch entry arguments, not owned
+
+    HS_ReqCtxt(afb_req_t request, int verb_id, struct json_object *args = nullptr);
+    ~HS_ReqCtxt();
+    HS_ReqCtxt(HS_ReqCtxt const &) = delete;
+    HS_ReqCtxt &operator=(HS_ReqCtxt const &) = delete;
+
+    const char* value(const char *key) const;
+    const char* callerId(void);
+
+private:
+    char *caller = nullptr;         // from afb_req_get_application_id, got on first use
+    bool caller_resolved = false;
+};
+
+REQ_ERROR get_value_uint16(HS_ReqCtxt &ctxt, const char *source, uint16_t *out_id);
+REQ_ERROR get_value_int16(HS_ReqCtxt &ctxt, const char *source, int16_t *out_id);
+REQ_ERROR get_value_int32(HS_ReqCtxt &ctxt, const char *source, int32_t *out_id);
 void hs_add_object_to_json_object(struct json_object* j_obj, int count, ...);
 void hs_add_object_to_json_object_str(struct json_object* j_obj, int count, ...);
 void hs_add_object_to_json_object_func(struct json_object* j_obj, const char* verb_name, int count, ...);
+void hs_add_telemetry_to_json_object(struct json_object* j_obj, const HS_TelemetryFrame &frame,
+                                     unsigned int mask = HS_TELEMETRY_FIELD_ALL);
 int hs_search_event_name_index(const char* value);
-std::string get_application_id(const afb_req_t request);
+struct json_object* hs_json_share(struct json_object *obj);
+struct json_object* hs_reply_object(int verb_id, int error);
 
 typedef int (*event_hook_func)(afb_api_t api, const char *event, struct json_object *object);
 void setEventHook(const char *event, const event_hook_func f);
@@ -0,0 +1,432 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include "hs-log.h"
+
+#define FLUSH_INTERVAL_MS   200
+#define BATCH_BUFFER_SIZE   (64 * 1024)
+#define LINE_PREFIX_MAX     48
+
+static const char* level_name[] = {
+    "ERROR",
+    "WARNING",
+    "NOTICE",
+    "INFO",
+    "DEBUG"
+};
+
+/**
+ * parse log level from environment HS_LOG_LEVEL, name or number
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * log level
+ *
+ */
+static int level_from_env(void)
+{
+    const char *env = getenv("HS_LOG_LEVEL");
+    if(env == nullptr || *env == '\0')
+        return HS_LOGLEVEL_NOTICE;
+
+    for(int i = HS_LOGLEVEL_ERROR; i <= HS_LOGLEVEL_DEBUG; ++i) {
+        if(strcasecmp(env, level_name[i]) == 0)
+            return i;
+    }
+
+    char *endptr;
+    long lvl = strtol(env, &endptr, 10);
+    if(*endptr != '\0' || lvl < HS_LOGLEVEL_ERROR || lvl > HS_LOGLEVEL_DEBUG)
+        return HS_LOGLEVEL_NOTICE;
+    return (int)lvl;
+}
+
+/**
+ * get instance
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * HS_Logger instance pointer
+ *
+ */
+HS_Logger* HS_Logger::instance(void)
+{
+    // never destroyed, threads may still log while the process exits
+    static HS_Logger *me = new HS_Logger();
+    return me;
+}
+
+/**
+ * HS_Logger construction function
+ *
+ * #### Parameters
+ *  - path : log file path
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_Logger::HS_Logger(const char *path)
+    : path(path), enqueue_pos(0), level(level_from_env()), running(false), sleeping(false),
+      queued(0), dropped(0), written_bytes(0), batches(0), rotations(0)
+{
+    slots = new Slot[HS_LOG_QUEUE_SIZE];
+    for(size_t i = 0; i < HS_LOG_QUEUE_SIZE; ++i)
+        slots[i].seq.store(i, std::memory_order_relaxed);
+
+    wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    running = true;
+    if(pthread_create(&tid, NULL, &HS_Logger::threadMain, this) != 0) {
+        fprintf(stderr, "HS_Logger: create flusher thread failed\n");
+        running = false;
+    }
+}
+
+/**
+ * HS_Logger destruction function
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_Logger::~HS_Logger()
+{
+    stop();
+    if(wakefd >= 0)
+        close(wakefd);
+    delete[] slots;
+}
+
+/**
+ * set file rotation parameter
+ *
+ * #### Parameters
+ *  - max_size : rotate when file size exceeds it
+ *  - count : number of rotated files kept, liked file.txt.1 ... file.txt.<count>
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Logger::setRotation(size_t max_size, int count)
+{
+    this->max_size = max_size;
+    this->rotate_count = count;
+}
+
+/**
+ * put a message in queue, never blocks
+ *
+ * #### Parameters
+ *  - level : log level
+ *  - fmt : printf format
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Logger::log(int level, const char *fmt, ...)
+{
+    Slot *slot;
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    for(;;) {
+        slot = &slots[pos & (HS_LOG_QUEUE_SIZE - 1)];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if(dif == 0) {
+            if(enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if(dif < 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed);  // queue full
+            return;
+        }
+        else {
+            pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    clock_gettime(CLOCK_REALTIME, &slot->ts);
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+    va_end(args);
+    if(len < 0)
+        len = 0;
+    else if(len >= (int)sizeof(slot->text))
+        len = sizeof(slot->text) - 1;
+    // drop trailing line breaks, flusher appends one
+    while(len > 0 && (slot->text[len - 1] == '\n' || slot->text[len - 1] == '\r'))
+        --len;
+    slot->len = len;
+    slot->seq.store(pos + 1, std::memory_order_release);
+
+    queued.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(sleeping.load(std::memory_order_relaxed) && sleeping.exchange(false))
+        wakeup();
+}
+
+/**
+ * ask flusher to write queued messages now
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Logger::flush(void)
+{
+    wakeup();
+}
+
+/**
+ * write remaining messages and stop flusher thread
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Logger::stop(void)
+{
+    if(!running.exchange(false))
+        return;
+    wakeup();
+    pthread_join(tid, NULL);
+}
+
+/**
+ * get logger statistics
+ *
+ * #### Parameters
+ *  - stats : [OUT] statistics
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Logger::getStats(HS_LogStats *stats) const
+{
+    stats->queued = queued.load(std::memory_order_relaxed);
+    stats->dropped = dropped.load(std::memory_order_relaxed);
+    stats->written_bytes = written_bytes.load(std::memory_order_relaxed);
+    stats->batches = batches.load(std::memory_order_relaxed);
+    stats->rotations = rotations.load(std::memory_order_relaxed);
+}
+
+void HS_Logger::wakeup(void)
+{
+    uint64_t one = 1;
+    ssize_t ret = write(wakefd, &one, sizeof(one));
+    (void)ret;  // EAGAIN means flusher is woken already
+}
+
+void* HS_Logger::threadMain(void *arg)
+{
+    static_cast<HS_Logger*>(arg)->run();
+    return NULL;
+}
+
+/**
+ * open log file, fall back to stderr when it can't be opened
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Logger::openFile(void)
+{
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        fprintf(stderr, "HS_Logger: open %s failed(%s), log to stderr\n", path.c_str(), strerror(errno));
+        fd = STDERR_FILENO;
+        file_size = 0;
+        return;
+    }
+
+    struct stat st;
+    file_size = (fstat(fd, &st) == 0) ? st.st_size : 0;
+}
+
+/**
+ * rotate log file, file.txt -> file.txt.1 -> ... -> file.txt.<rotate_count>
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Logger::rotate(void)
+{
+    if(fd == STDERR_FILENO)
+        return;
+
+    close(fd);
+    for(int i = rotate_count - 1; i >= 1; --i) {
+        std::string from = path + "." + std::to_string(i);
+        std::string to = path + "." + std::to_string(i + 1);
+        rename(from.c_str(), to.c_str());
+    }
+    if(rotate_count > 0)
+        rename(path.c_str(), (path + ".1").c_str());
+    else
+        unlink(path.c_str());
+
+    rotations.fetch_add(1, std::memory_order_relaxed);
+    openFile();
+}
+
+void HS_Logger::writeOut(const char *buf, size_t len)
+{
+    if(fd < 0)
+        openFile();
+
+    size_t done = 0;
+    while(done < len) {
+        ssize_t n = write(fd, buf + done, len - done);
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+        done += n;
+    }
+
+    file_size += done;
+    written_bytes.fetch_add(done, std::memory_order_relaxed);
+    batches.fetch_add(1, std::memory_order_relaxed);
+    if(max_size > 0 && file_size >= max_size)
+        rotate();
+}
+
+/**
+ * format queued messages into batch buffer and write them
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * number of written messages
+ *
+ */
+size_t HS_Logger::drain(void)
+{
+    static char batch[BATCH_BUFFER_SIZE];
+    size_t used = 0;
+    size_t count = 0;
+
+    for(;;) {
+        Slot *slot = &slots[dequeue_pos & (HS_LOG_QUEUE_SIZE - 1)];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        if(seq != dequeue_pos + 1)
+            break;  // empty
+
+        if(used + LINE_PREFIX_MAX + slot->len + 1 > sizeof(batch)) {
+            writeOut(batch, used);
+            used = 0;
+        }
+
+        struct tm tm;
+        localtime_r(&slot->ts.tv_sec, &tm);
+        int level = slot->level;
+        if(level < HS_LOGLEVEL_ERROR || level > HS_LOGLEVEL_DEBUG)
+            level = HS_LOGLEVEL_DEBUG;
+        used += strftime(batch + used, LINE_PREFIX_MAX, "%Y-%m-%d %H:%M:%S", &tm);
+        used += snprintf(batch + used, LINE_PREFIX_MAX, ".%03ld [%s] ",
+                         slot->ts.tv_nsec / 1000000, level_name[level]);
+        memcpy(batch + used, slot->text, slot->len);
+        used += slot->len;
+        batch[used++] = '\n';
+
+        slot->seq.store(dequeue_pos + HS_LOG_QUEUE_SIZE, std::memory_order_release);
+        ++dequeue_pos;
+        ++count;
+    }
+
+    if(used > 0)
+        writeOut(batch, used);
+    return count;
+}
+
+/**
+ * flusher thread main loop
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Logger::run(void)
+{
+    while(running.load()) {
+        if(drain() > 0)
+            continue;
+
+        sleeping.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(drain() > 0) {   // message arrived before producers could see sleeping
+            sleeping.store(false);
+            continue;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = wakefd;
+        pfd.events = POLLIN;
+        if(poll(&pfd, 1, FLUSH_INTERVAL_MS) > 0) {
+            uint64_t val;
+            ssize_t ret = read(wakefd, &val, sizeof(val));
+            (void)ret;
+        }
+        sleeping.store(false);
+    }
+
+    drain();
+    if(fd >= 0 && fd != STDERR_FILENO) {
+        close(fd);
+        fd = -1;
+    }
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOMESCREEN_LOG_H
+#define HOMESCREEN_LOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include <pthread.h>
+#include <time.h>
+
+#define HS_LOG_DEFAULT_FILE     "/home/1001/app-data/agl-service-homescreen/file.txt"
+#define HS_LOG_QUEUE_SIZE       1024        // power of two
+#define HS_LOG_MSG_MAX          240
+#define HS_LOG_MAX_FILE_SIZE    (1024 * 1024)
+#define HS_LOG_ROTATE_COUNT     3
+
+enum HS_LogLevel {
+    HS_LOGLEVEL_ERROR = 0,
+    HS_LOGLEVEL_WARNING,
+    HS_LOGLEVEL_NOTICE,
+    HS_LOGLEVEL_INFO,
+    HS_LOGLEVEL_DEBUG
+};
+
+struct HS_LogStats {
+    uint64_t queued;
+    uint64_t dropped;
+    uint64_t written_bytes;
+    uint64_t batches;
+    uint32_t rotations;
+};
+
+/*
+ * asynchronous file logger.
+ * any thread can log without blocking, messages are put in a bounded
+ * lock-free queue and written to file in batches by a flusher thread.
+ * messages are dropped and counted when the queue is full.
+ */
+class HS_Logger {
+public:
+    HS_Logger(const char *path = HS_LOG_DEFAULT_FILE);
+    ~HS_Logger();
+    HS_Logger(HS_Logger const &) = delete;
+    HS_Logger &operator=(HS_Logger const &) = delete;
+
+    static HS_Logger* instance(void);
+
+    bool isEnabled(int level) const { return level <= this->level.load(std::memory_order_relaxed); }
+    void setLevel(int level) { this->level.store(level, std::memory_order_relaxed); }
+    void setRotation(size_t max_size, int count);
+    void log(int level, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+    void flush(void);
+    void stop(void);
+    void getStats(HS_LogStats *stats) const;
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        int level;
+        struct timespec ts;
+        unsigned int len;
+        char text[HS_LOG_MSG_MAX];
+    };
+
+    static void* threadMain(void *arg);
+    void run(void);
+    size_t drain(void);
+    void openFile(void);
+    void rotate(void);
+    void writeOut(const char *buf, size_t len);
+    void wakeup(void);
+
+private:
+    std::string path;
+    Slot *slots;
+    std::atomic<size_t> enqueue_pos;
+    size_t dequeue_pos = 0;
+
+    std::atomic<int> level;
+    size_t max_size = HS_LOG_MAX_FILE_SIZE;
+    int rotate_count = HS_LOG_ROTATE_COUNT;
+    int fd = -1;
+    size_t file_size = 0;
+
+    pthread_t tid;
+    std::atomic<bool> running;
+    std::atomic<bool> sleeping;
+    int wakefd = -1;
+
+    std::atomic<uint64_t> queued;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> written_bytes;
+    std::atomic<uint64_t> batches;
+    std::atomic<uint32_t> rotations;
+};
+
+#define HS_LOG(lvl, ...) \
+    do { \
+        HS_Logger *_hs_logger = HS_Logger::instance(); \
+        if(_hs_logger->isEnabled(lvl)) \
+            _hs_logger->log(lvl, __VA_ARGS__); \
+    } while(0)
+
+#define HS_LOG_ERROR(...)   HS_LOG(HS_LOGLEVEL_ERROR, __VA_ARGS__)
+#define HS_LOG_WARNING(...) HS_LOG(HS_LOGLEVEL_WARNING, __VA_ARGS__)
+#define HS_LOG_NOTICE(...)  HS_LOG(HS_LOGLEVEL_NOTICE, __VA_ARGS__)
+#define HS_LOG_INFO(...)    HS_LOG(HS_LOGLEVEL_INFO, __VA_ARGS__)
+#define HS_LOG_DEBUG(...)   HS_LOG(HS_LOGLEVEL_DEBUG, __VA_ARGS__)
+
+#endif // HOMESCREEN_LOG_H
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include "hs-pool.h"
+
+/**
+ * HS_SlabPool construction function
+ *
+ * #### Parameters
+ *  - slot_size : biggest object size served from pool
+ *  - slab_slots : slots allocated from heap at once
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_SlabPool::HS_SlabPool(size_t slot_size, size_t slab_slots)
+    : slot_size(slot_size), slab_slots(slab_slots)
+{
+    const size_t align = alignof(std::max_align_t);
+    stride = (offsetof(Slot, data) + slot_size + align - 1) / align * align;
+}
+
+/**
+ * HS_SlabPool destruction function, objects still in use must not be
+ * accessed afterwards
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_SlabPool::~HS_SlabPool()
+{
+    for(auto slab : slabs)
+        free(slab);
+}
+
+/**
+ * allocate memory from pool
+ *
+ * #### Parameters
+ *  - size : requested size, bigger than slot size is served by heap
+ *
+ * #### Return
+ * memory pointer, aligned for any object
+ *
+ */
+void* HS_SlabPool::allocate(size_t size)
+{
+    if(size > slot_size) {
+        std::lock_guard<std::mutex> lock(this->mtx);
+        ++stats.oversize_allocs;
+        return ::operator new(size);
+    }
+
+    std::lock_guard<std::mutex> lock(this->mtx);
+    if(free_list == nullptr && !grow())
+        throw std::bad_alloc();
+
+    Slot *slot = free_list;
+    free_list = slot->next_free;
+    slot->next_free = nullptr;
+    if(slot->generation != 0)
+        ++stats.slot_reuses;
+    ++slot->generation;     // becomes odd
+    ++stats.slot_allocs;
+    if(++stats.in_use > stats.peak)
+        stats.peak = stats.in_use;
+    return slot->data;
+}
+
+/**
+ * give memory back to pool
+ *
+ * #### Parameters
+ *  - p : memory from allocate
+ *  - size : size passed to allocate
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_SlabPool::deallocate(void *p, size_t size)
+{
+    if(p == nullptr)
+        return;
+    if(size > slot_size) {
+        ::operator delete(p);
+        return;
+    }
+
+    Slot *slot = reinterpret_cast<Slot*>(static_cast<unsigned char*>(p) - offsetof(Slot, data));
+    std::lock_guard<std::mutex> lock(this->mtx);
+    ++slot->generation;     // becomes even, handles turn stale
+    if(slot->generation == 0)
+        slot->generation = 2;
+    slot->next_free = free_list;
+    free_list = slot;
+    ++stats.slot_frees;
+    --stats.in_use;
+}
+
+/**
+ * get stable handle of memory from pool
+ *
+ * #### Parameters
+ *  - p : memory from allocate, or any address inside it
+ *
+ * #### Return
+ * handle, generation is 0 when p isn't a pool slot
+ *
+ */
+HS_PoolHandle HS_SlabPool::handleOf(const void *p) const
+{
+    HS_PoolHandle handle;
+    std::lock_guard<std::mutex> lock(this->mtx);
+    Slot *slot = slotOf(p);
+    if(slot != nullptr && (slot->generation & 1)) {
+        handle.index = slot->index;
+        handle.generation = slot->generation;
+    }
+    return handle;
+}
+
+/**
+ * resolve handle
+ *
+ * #### Parameters
+ *  - handle : handle from handleOf
+ *
+ * #### Return
+ * memory pointer, nullptr : slot was freed
+ *
+ */
+void* HS_SlabPool::get(HS_PoolHandle handle) const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    Slot *slot = slotAt(handle.index);
+    if(slot == nullptr || handle.generation == 0 || slot->generation != handle.generation)
+        return nullptr;
+    return slot->data;
+}
+
+/**
+ * get pool statistics
+ *
+ * #### Parameters
+ *  - stats : [OUT] statistics
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_SlabPool::getStats(HS_PoolStats *stats) const
+{
+    std::lock_guard<std::mutex> lock(this->mtx);
+    *stats = this->stats;
+}
+
+HS_SlabPool::Slot* HS_SlabPool::slotAt(uint32_t index) const
+{
+    size_t slab = index / slab_slots;
+    if(slab >= slabs.size())
+        return nullptr;
+    return reinterpret_cast<Slot*>(slabs[slab] + (index % slab_slots) * stride);
+}
+
+// slot containing p, p may point inside the slot
+HS_SlabPool::Slot* HS_SlabPool::slotOf(const void *p) const
+{
+    const unsigned char *addr = static_cast<const unsigned char*>(p);
+    for(auto slab : slabs) {
+        if(addr >= slab && addr < slab + slab_slots * stride)
+            return reinterpret_cast<Slot*>(slab + (addr - slab) / stride * stride);
+    }
+    return nullptr;
+}
+
+/**
+ * allocate one more slab and put its slots on free list, called with mtx locked
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * true : success
+ * false : out of memory
+ *
+ */
+bool HS_SlabPool::grow(void)
+{
+    unsigned char *slab = static_cast<unsigned char*>(aligned_alloc(alignof(std::max_align_t), slab_slots * stride));
+    if(slab == nullptr)
+        return false;
+    memset(slab, 0, slab_slots * stride);
+
+    uint32_t base = (uint32_t)(slabs.size() * slab_slots);
+    slabs.push_back(slab);
+    ++stats.slab_allocs;
+    for(size_t i = slab_slots; i-- > 0; ) {
+        Slot *slot = reinterpret_cast<Slot*>(slab + i * stride);
+        slot->index = base + (uint32_t)i;
+        slot->generation = 0;
+        slot->next_free = free_list;
+        free_list = slot;
+    }
+    return true;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOMESCREEN_POOL_H
+#define HOMESCREEN_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <mutex>
+#include <vector>
+
+#define HS_POOL_SLAB_SLOTS  32      // slots allocated from heap at once
+
+// stable reference of pool slot, stale after slot is freed
+struct HS_PoolHandle {
+    uint32_t index = 0;
+    uint32_t generation = 0;    // 0 : invalid handle
+
+    bool operator==(const HS_PoolHandle &other) const
+    { return index == other.index && generation == other.generation; }
+};
+
+// pool slot counters, allocations made by the objects in slots aren't seen
+struct HS_PoolStats {
+    uint64_t slot_allocs;       // slots handed out
+    uint64_t slot_reuses;       // slots handed out again after a free
+    uint64_t slot_frees;        // slots given back
+    uint64_t slab_allocs;       // heap allocations of slabs, constant once peak is reached
+    uint64_t oversize_allocs;   // requests bigger than slot, served by heap
+    uint32_t in_use;
+    uint32_t peak;
+};
+
+/*
+ * fixed size slot allocator.
+ * slots are carved from slabs of HS_POOL_SLAB_SLOTS, freed slots go to a
+ * free list and are reused, slabs are kept until the pool is destroyed,
+ * so slot alloc/free churn allocates no slab once the peak is reached.
+ * only the slots are pooled, an object in a slot still allocates its own
+ * members from heap.
+ * every slot carries a generation which is bumped on free, so a handle
+ * of a freed and reused slot is detected as stale.
+ */
+class HS_SlabPool {
+public:
+    HS_SlabPool(size_t slot_size, size_t slab_slots = HS_POOL_SLAB_SLOTS);
+    ~HS_SlabPool();
+    HS_SlabPool(HS_SlabPool const &) = delete;
+    HS_SlabPool &operator=(HS_SlabPool const &) = delete;
+
+    void* allocate(size_t size);
+    void deallocate(void *p, size_t size);
+    HS_PoolHandle handleOf(const void *p) const;
+    void* get(HS_PoolHandle handle) const;
+    void getStats(HS_PoolStats *stats) const;
+
+    template<class T, class... Args>
+    T* create(Args&&... args)
+    {
+        return new(allocate(sizeof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template<class T>
+    void destroy(T *p)
+    {
+        if(p == nullptr)
+            return;
+        p->~T();
+        deallocate(p, sizeof(T));
+    }
+
+private:
+    struct Slot {
+        Slot *next_free;
+        uint32_t index;
+        uint32_t generation;    // odd : in use
+        alignas(std::max_align_t) unsigned char data[1];
+    };
+
+    Slot* slotAt(uint32_t index) const;
+    Slot* slotOf(const void *p) const;
+    bool grow(void);
+
+private:
+    size_t slot_size;
+    size_t slab_slots;
+    size_t stride;
+    std::vector<unsigned char*> slabs;
+    Slot *free_list = nullptr;
+    mutable std::mutex mtx;
+    HS_PoolStats stats = {};
+};
+
+/*
+ * allocator over HS_SlabPool for std::allocate_shared, the object and
+ * its shared_ptr control block share one slot.
+ */
+template<class T>
+struct HS_PoolAllocator {
+    typedef T value_type;
+
+    HS_SlabPool *pool;
+
+    explicit HS_PoolAllocator(HS_SlabPool *pool) : pool(pool) {}
+    template<class U>
+    HS_PoolAllocator(const HS_PoolAllocator<U> &other) : pool(other.pool) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(pool->allocate(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { pool->deallocate(p, n * sizeof(T)); }
+};
+
+template<class T, class U>
+bool operator==(const HS_PoolAllocator<T> &a, const HS_PoolAllocator<U> &b) { return a.pool == b.pool; }
+template<class T, class U>
+bool operator!=(const HS_PoolAllocator<T> &a, const HS_PoolAllocator<U> &b) { return a.pool != b.pool; }
+
+#endif // HOMESCREEN_POOL_H
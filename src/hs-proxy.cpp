@@ -19,6 +19,7 @@
 
 struct closure_data {
 	std::string appid;
+	HS_PoolHandle client;
 	HS_ClientCtxt *clientCtx;
 	struct hs_instance *hs_instance;
 };
@@ -58,10 +59,10 @@ static void api_callback(void *closure, struct json_object *object, const char *
     /* if we have an error then we couldn't start the application so we remove it */
     if (error) {
 	   AFB_INFO("asynchronous call, removing client %s", cdata->appid.c_str());
-           clientManager->removeClient(cdata->appid);
+           clientManager->removeClient(cdata->appid, cdata->client);
     }
 
-    free(cdata);
+    delete cdata;
 }
 
 /**
@@ -188,15 +189,34 @@ void HS_AfmMainProxy::start(struct hs_instance *instance, afb_req_t request, con
     if (!instance || id.empty())
 	    return;
 
-    cdata = static_cast<struct closure_data *>(calloc(1, sizeof(*cdata)));
-    cdata->hs_instance = instance;
-    cdata->appid = id;
-
     struct HS_ClientManager *clientManager = instance->client_manager;
     if (!clientManager) {
 	    return;
     }
 
-    clientManager->addClient(request, id);
+    cdata = new closure_data();
+    cdata->hs_instance = instance;
+    cdata->appid = id;
+
+    auto client = clientManager->addClient(request, id);
+    cdata->client = clientManager->getClientHandle(client.get());
     api_call(request->api, _afm_main, __FUNCTION__, json_object_new_string(id.c_str()), cdata);
 }
+
+/**
+ * get running application list asynchronously, ps blocks in
+ * afm-system-daemon and must not be called synchronously from a request
+ *
+ * #### Parameters
+ *  - api : the api serving the request
+ *  - f : reply callback, object is json array of runners
+ *  - closure : argument of f
+ *
+ * #### Return
+ *  None
+ *
+ */
+void HS_AfmMainProxy::ps(afb_api_t api, reply_func f, void *closure)
+{
+    afb_api_call(api, _afm_main, "runners", nullptr, f, closure);
+}
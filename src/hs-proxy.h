@@ -23,6 +23,8 @@
 #include "hs-helper.h"
 
 struct HS_AfmMainProxy {
+    typedef void (*reply_func)(void *closure, struct json_object *object, const char *error, const char *info, afb_api_t api);
+
     // synchronous call, call result in object
     int runnables(afb_api_t api, struct json_object **object);
     int ps(afb_api_t api, struct json_object **object);
@@ -30,6 +32,7 @@ struct HS_AfmMainProxy {
 
     // asynchronous call, reply in callback function
     void start(struct hs_instance *hs_instance, afb_req_t request, const std::string &id);
+    void ps(afb_api_t api, reply_func f, void *closure);
 };
 
 #endif // HOMESCREEN_PROXY_H
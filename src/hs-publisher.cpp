@@ -0,0 +1,680 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "hs-publisher.h"
+#include "hs-scheduler.h"
+#include "hs-log.h"
+
+#define MAX_EPOLL_EVENTS    32
+#define LISTEN_RETRY_MS     500
+#define LISTEN_RETRY_MAX_MS 30000
+#define LISTEN_BACKLOG      16
+#define FRAME_TEXT_MAX      160
+
+// render cache of one frame, indexed by delta mask, json slot 0 holds
+// the legacy json text since mask 0 is never sent
+struct HS_TelemetryPublisher::Rendered {
+    uint64_t has_json = 0;      // bit per mask
+    uint64_t has_binary = 0;
+    unsigned short json_len[HS_TELEMETRY_MASK_COUNT];
+    unsigned char binary_len[HS_TELEMETRY_MASK_COUNT];
+    char json[HS_TELEMETRY_MASK_COUNT][FRAME_TEXT_MAX];
+    unsigned char binary[HS_TELEMETRY_MASK_COUNT][HS_TELEMETRY_RECORD_SIZE];
+};
+
+/**
+ * HS_TelemetryPublisher construction function
+ *
+ * #### Parameters
+ *  - address : listen address
+ *  - port : listen port
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_TelemetryPublisher::HS_TelemetryPublisher(const char *address, int port)
+    : address(address), port(port), running(false), queue_head(0), queue_tail(0), wake_pending(false),
+      client_count(0), accepted(0), frames(0), queue_dropped(0), client_dropped(0), coalesced(0)
+{
+}
+
+/**
+ * HS_TelemetryPublisher destruction function
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_TelemetryPublisher::~HS_TelemetryPublisher()
+{
+    stop();
+}
+
+/**
+ * start publisher thread
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * 0 : success
+ * -1 : fail
+ *
+ */
+int HS_TelemetryPublisher::start(void)
+{
+    if(started)
+        return 0;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(epfd < 0 || wakefd < 0) {
+        HS_LOG_ERROR("publisher epoll/eventfd create failed(%s)", strerror(errno));
+        stop();
+        return -1;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = wakefd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev);
+
+    running = true;
+    if(pthread_create(&tid, NULL, &HS_TelemetryPublisher::threadMain, this) != 0) {
+        running = false;
+        stop();
+        return -1;
+    }
+    started = true;
+    return 0;
+}
+
+/**
+ * stop publisher thread, close all connections
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_TelemetryPublisher::stop(void)
+{
+    if(started) {
+        running = false;
+        uint64_t one = 1;
+        ssize_t ret = write(wakefd, &one, sizeof(one));
+        (void)ret;
+        pthread_join(tid, NULL);
+        started = false;
+    }
+
+    while(!clients.empty())
+        closeClient(clients.begin()->second);
+    if(listenfd >= 0) {
+        close(listenfd);
+        listenfd = -1;
+    }
+    if(wakefd >= 0) {
+        close(wakefd);
+        wakefd = -1;
+    }
+    if(epfd >= 0) {
+        close(epfd);
+        epfd = -1;
+    }
+}
+
+/**
+ * queue a frame for publishing, called in serial reader thread, never blocks
+ *
+ * #### Parameters
+ *  - frame : decoded frame
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_TelemetryPublisher::publish(const HS_TelemetryFrame &frame)
+{
+    size_t tail = queue_tail.load(std::memory_order_relaxed);
+    if(tail - queue_head.load(std::memory_order_acquire) >= HS_PUBLISHER_QUEUE_SIZE) {
+        queue_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    queue[tail & (HS_PUBLISHER_QUEUE_SIZE - 1)] = frame;
+    queue_tail.store(tail + 1, std::memory_order_release);
+
+    if(!wake_pending.exchange(true)) {
+        uint64_t one = 1;
+        ssize_t ret = write(wakefd, &one, sizeof(one));
+        (void)ret;
+    }
+}
+
+/**
+ * get publisher statistics
+ *
+ * #### Parameters
+ *  - stats : [OUT] statistics
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_TelemetryPublisher::getStats(HS_PublisherStats *stats) const
+{
+    stats->clients = client_count.load(std::memory_order_relaxed);
+    stats->accepted = accepted.load(std::memory_order_relaxed);
+    stats->frames = frames.load(std::memory_order_relaxed);
+    stats->queue_dropped = queue_dropped.load(std::memory_order_relaxed);
+    stats->client_dropped = client_dropped.load(std::memory_order_relaxed);
+    stats->coalesced = coalesced.load(std::memory_order_relaxed);
+}
+
+void* HS_TelemetryPublisher::threadMain(void *arg)
+{
+    static_cast<HS_TelemetryPublisher*>(arg)->run();
+    return NULL;
+}
+
+/**
+ * create non-blocking listen socket and add it to epoll
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * 0 : success
+ * -1 : fail
+ *
+ */
+int HS_TelemetryPublisher::openListener(void)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+        return -1;
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in serv_addr;
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = inet_addr(address.c_str());
+    serv_addr.sin_port = htons(port);
+    if(bind(fd, (struct sockaddr*)&serv_addr, sizeof(serv_addr)) < 0
+    || listen(fd, LISTEN_BACKLOG) < 0) {
+        HS_LOG_WARNING("publisher listen %s:%d failed(%s)", address.c_str(), port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    listenfd = fd;
+    HS_LOG_NOTICE("publisher listening on %s:%d", address.c_str(), port);
+    return 0;
+}
+
+/**
+ * accept all pending connections
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_TelemetryPublisher::acceptClients(void)
+{
+    for(;;) {
+        int fd = accept4(listenfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                HS_LOG_WARNING("publisher accept failed(%s)", strerror(errno));
+            break;
+        }
+
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        Client *client = new Client();
+        client->fd = fd;
+        client->connected_ms = HS_Telemetry::now() / 1000000;
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = fd;
+        if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            delete client;
+            continue;
+        }
+        clients[fd] = client;
+        client_count.store(clients.size(), std::memory_order_relaxed);
+        accepted.fetch_add(1, std::memory_order_relaxed);
+        HS_LOG_INFO("publisher client connected, fd=%d, clients=%zu", fd, clients.size());
+    }
+}
+
+/**
+ * close client connection
+ *
+ * #### Parameters
+ *  - client : the client
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_TelemetryPublisher::closeClient(Client *client)
+{
+    HS_LOG_INFO("publisher client disconnected, fd=%d", client->fd);
+    epoll_ctl(epfd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    clients.erase(client->fd);
+    client_count.store(clients.size(), std::memory_order_relaxed);
+    delete client;
+}
+
+/**
+ * handle data from client, option lines or hang-up
+ *
+ * #### Parameters
+ *  - client : the client
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_TelemetryPublisher::onReadable(Client *client)
+{
+    char buf[128];
+    for(;;) {
+        ssize_t n = recv(client->fd, buf, sizeof(buf), 0);
+        if(n > 0) {
+            bool negotiated = client->negotiated;
+            client->in.append(buf, n);
+            size_t pos;
+            while((pos = client->in.find('\n')) != std::string::npos) {
+                parseOptions(client, client->in.substr(0, pos));
+                client->in.erase(0, pos + 1);
+            }
+            if(client->in.size() > HS_PUBLISHER_OPTION_MAX) {
+                HS_LOG_WARNING("publisher client fd=%d option line too long", client->fd);
+                client->in.clear();
+                client->negotiated = true;
+            }
+            if(!negotiated && client->negotiated && have_latest) {
+                // frames of negotiation window were not sent, start with current state
+                client->want_latest = true;
+                if(!client->writable_armed && !flushClient(client))
+                    return;
+            }
+            continue;
+        }
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return;
+        closeClient(client);
+        return;
+    }
+}
+
+/**
+ * parse client option line, space separated key=value pairs
+ *  - mode=json|binary : wire format
+ *  - others : HS_TelemetryFilter::setOption, liked "delta=1 rate=10 batteryLev=5"
+ *
+ * #### Parameters
+ *  - client : the client
+ *  - line : option line without line break
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_TelemetryPublisher::parseOptions(Client *client, const std::string &line)
+{
+    size_t pos = 0;
+    while(pos < line.size()) {
+        size_t end = line.find_first_of(" \t\r", pos);
+        if(end == std::string::npos)
+            end = line.size();
+        std::string opt = line.substr(pos, end - pos);
+        pos = end + 1;
+        if(opt.empty())
+            continue;
+
+        size_t eq = opt.find('=');
+        std::string key = opt.substr(0, eq);
+        std::string value = (eq == std::string::npos) ? std::string() : opt.substr(eq + 1);
+        if(key == "mode" && value == "binary")
+            client->mode = HS_WIRE_BINARY;
+        else if(key == "mode" && value == "json")
+            client->mode = HS_WIRE_JSON;
+        else if(!client->filter.setOption(key.c_str(), value.c_str()))
+            HS_LOG_WARNING("publisher client fd=%d unknown option %s", client->fd, opt.c_str());
+    }
+    client->negotiated = true;
+    HS_LOG_INFO("publisher client fd=%d mode=%s delta=%d keyframe=%u interval=%llums watched=0x%x", client->fd,
+                client->mode == HS_WIRE_BINARY ? "binary" : "json",
+                client->filter.enabled, client->filter.keyframe_interval,
+                (unsigned long long)(client->filter.min_interval_ns / 1000000), client->filter.watched);
+}
+
+/**
+ * check if client finished option negotiation
+ *
+ * #### Parameters
+ *  - client : the client
+ *  - now_ms : current monotonic time in milliseconds
+ *
+ * #### Return
+ * true : frames can be sent
+ * false : still waiting for options
+ *
+ */
+bool HS_TelemetryPublisher::isReady(Client *client, uint64_t now_ms)
+{
+    if(!client->negotiated && now_ms - client->connected_ms >= HS_PUBLISHER_NEGOTIATE_MS)
+        client->negotiated = true;
+    return client->negotiated;
+}
+
+/**
+ * write pending output, when frames were skipped for this client and
+ * everything is written, the latest frame is sent once more so that the
+ * client catches up with current state
+ *
+ * #### Parameters
+ *  - client : the client
+ *
+ * #### Return
+ * true : client is alive
+ * false : client was closed
+ *
+ */
+bool HS_TelemetryPublisher::flushClient(Client *client)
+{
+    for(;;) {
+        while(client->out_off < client->out.size()) {
+            ssize_t n = send(client->fd, client->out.data() + client->out_off,
+                             client->out.size() - client->out_off, MSG_NOSIGNAL);
+            if(n > 0) {
+                client->out_off += n;
+                continue;
+            }
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                armWritable(client, true);
+                return true;
+            }
+            closeClient(client);
+            return false;
+        }
+
+        client->out.clear();
+        client->out_off = 0;
+        if(!client->want_latest || !have_latest)
+            break;
+
+        Rendered rendered;
+        const char *data;
+        size_t len;
+        unsigned int mask = HS_TELEMETRY_FIELD_ALL | HS_TELEMETRY_KEYFRAME;
+        render(client, latest, rendered, mask, &data, &len);
+        client->want_latest = false;
+        client->out.assign(data, len);
+        client->filter.sent(latest, mask);
+        coalesced.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    armWritable(client, false);
+    return true;
+}
+
+void HS_TelemetryPublisher::armWritable(Client *client, bool enable)
+{
+    if(client->writable_armed == enable)
+        return;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    if(enable)
+        ev.events |= EPOLLOUT;
+    ev.data.fd = client->fd;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, client->fd, &ev);
+    client->writable_armed = enable;
+}
+
+/**
+ * append one frame to client output as client's filter decides, the
+ * frame is skipped when client has too much pending output
+ *
+ * #### Parameters
+ *  - client : the client
+ *  - frame : decoded frame
+ *  - rendered : per frame render cache shared by all clients
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_TelemetryPublisher::sendFrame(Client *client, const HS_TelemetryFrame &frame, Rendered &rendered)
+{
+    unsigned int mask = client->filter.mask(frame);
+    if(mask == 0)
+        return;     // filtered out
+
+    const char *data;
+    size_t len;
+    render(client, frame, rendered, mask, &data, &len);
+    if(client->out.size() - client->out_off + len > HS_PUBLISHER_HIGH_WATER) {
+        client->want_latest = true;
+        client_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    client->out.append(data, len);
+    client->want_latest = false;
+    client->filter.sent(frame, mask);
+}
+
+/**
+ * render frame in client's wire mode, every mode and delta mask is
+ * rendered at most once per frame
+ *
+ * #### Parameters
+ *  - client : the client
+ *  - frame : decoded frame
+ *  - rendered : render cache of this frame
+ *  - mask : fields to render, HS_TelemetryFilter::mask
+ *  - data : [OUT] rendered data
+ *  - len : [OUT] rendered length
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_TelemetryPublisher::render(Client *client, const HS_TelemetryFrame &frame, Rendered &rendered,
+                                   unsigned int mask, const char **data, size_t *len)
+{
+    if(client->mode == HS_WIRE_BINARY) {
+        if(!(rendered.has_binary & (1ULL << mask))) {
+            rendered.binary_len[mask] = (unsigned char)hs_telemetry_encode_delta(frame, mask, rendered.binary[mask]);
+            rendered.has_binary |= 1ULL << mask;
+        }
+        *data = (const char*)rendered.binary[mask];
+        *len = rendered.binary_len[mask];
+        return;
+    }
+
+    unsigned int slot = client->filter.enabled ? mask : 0;
+    if(!(rendered.has_json & (1ULL << slot))) {
+        char *text = rendered.json[slot];
+        int n;
+        if(slot == 0) {
+            n = snprintf(text, FRAME_TEXT_MAX,
+                         "{\"odo\":%d, \"curSpeed\":%d, \"batteryLev\":%d, \"signalLightLeft\":%d, \"signalLightRight\":%d}",
+                         frame.odo, frame.curSpeed, frame.batteryLev, frame.signalLightLeft, frame.signalLightRight);
+        }
+        else {
+            n = snprintf(text, FRAME_TEXT_MAX, "{\"seq\":%u%s", frame.seq,
+                         (mask & HS_TELEMETRY_KEYFRAME) ? ", \"keyframe\":1" : "");
+            for(int i = 0; i < HS_TELEMETRY_FIELD_COUNT; ++i) {
+                if(mask & (1u << i))
+                    n += snprintf(text + n, FRAME_TEXT_MAX - n, ", \"%s\":%d",
+                                  hs_telemetry_field_name(i), hs_telemetry_field_value(frame, i));
+            }
+            n += snprintf(text + n, FRAME_TEXT_MAX - n, "}");
+        }
+        if(n < 0)
+            n = 0;
+        rendered.json_len[slot] = n < FRAME_TEXT_MAX ? n : FRAME_TEXT_MAX - 1;
+        rendered.has_json |= 1ULL << slot;
+    }
+    *data = rendered.json[slot];
+    *len = rendered.json_len[slot];
+}
+
+/**
+ * render queued frames once per wire mode, append them to all clients
+ * and flush
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_TelemetryPublisher::drainQueue(void)
+{
+    uint64_t val;
+    ssize_t ret = read(wakefd, &val, sizeof(val));
+    (void)ret;
+    wake_pending.store(false);
+
+    uint64_t now_ms = HS_Telemetry::now() / 1000000;
+    size_t head = queue_head.load(std::memory_order_relaxed);
+    size_t tail = queue_tail.load();   // ordered after wake_pending reset
+    while(head != tail) {
+        latest = queue[head & (HS_PUBLISHER_QUEUE_SIZE - 1)];
+        have_latest = true;
+        queue_head.store(++head, std::memory_order_release);
+        frames.fetch_add(1, std::memory_order_relaxed);
+
+        Rendered rendered;
+        for(auto &ref : clients) {
+            if(isReady(ref.second, now_ms))
+                sendFrame(ref.second, latest, rendered);
+        }
+        tail = queue_tail.load(std::memory_order_acquire);
+    }
+
+    // one write per client for the whole batch
+    for(auto it = clients.begin(); it != clients.end(); ) {
+        Client *client = it->second;
+        ++it;   // client may be closed in flushClient
+        if(!client->writable_armed && client->out_off < client->out.size())
+            flushClient(client);
+    }
+}
+
+/**
+ * publisher thread main loop
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_TelemetryPublisher::run(void)
+{
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    HS_Backoff backoff(LISTEN_RETRY_MS, LISTEN_RETRY_MAX_MS);
+    uint64_t retry_ms = 0;
+    while(running) {
+        int timeout = -1;
+        if(listenfd < 0) {
+            uint64_t now_ms = HS_Telemetry::now() / 1000000;
+            if(now_ms >= retry_ms) {
+                if(openListener() == 0) {
+                    backoff.reset();
+                }
+                else {
+                    retry_ms = now_ms + backoff.next();
+                }
+            }
+            if(listenfd < 0)
+                timeout = (int)(retry_ms > now_ms ? retry_ms - now_ms : 0);
+        }
+
+        int n = epoll_wait(epfd, events, MAX_EPOLL_EVENTS, timeout);
+        for(int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if(fd == wakefd) {
+                drainQueue();
+                continue;
+            }
+            if(fd == listenfd) {
+                acceptClients();
+                continue;
+            }
+
+            auto it = clients.find(fd);
+            if(it == clients.end())
+                continue;   // closed by an earlier event in this batch
+            Client *client = it->second;
+            if(events[i].events & (EPOLLERR | EPOLLHUP)) {
+                closeClient(client);
+                continue;
+            }
+            if(events[i].events & EPOLLOUT) {
+                if(!flushClient(client))
+                    continue;
+            }
+            if(events[i].events & (EPOLLIN | EPOLLRDHUP))
+                onReadable(client);
+        }
+    }
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOMESCREEN_PUBLISHER_H
+#define HOMESCREEN_PUBLISHER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <pthread.h>
+#include "hs-telemetry.h"
+
+#define HS_PUBLISHER_ADDRESS        "127.192.90.189"
+#define HS_PUBLISHER_PORT           5000
+#define HS_PUBLISHER_QUEUE_SIZE     1024        // power of two
+#define HS_PUBLISHER_HIGH_WATER     (32 * 1024) // per client pending output bytes
+#define HS_PUBLISHER_NEGOTIATE_MS   200         // wait for client options before streaming
+#define HS_PUBLISHER_OPTION_MAX     256         // max length of option line
+
+enum HS_WireMode {
+    HS_WIRE_JSON = 0,   // json text, no delimiter
+    HS_WIRE_BINARY      // HS_TELEMETRY_RECORD_SIZE byte records, see hs-telemetry.h
+};
+
+struct HS_PublisherStats {
+    uint32_t clients;
+    uint64_t accepted;
+    uint64_t frames;
+    uint64_t queue_dropped;     // frames lost before publisher thread saw them
+    uint64_t client_dropped;    // frames skipped for slow clients
+    uint64_t coalesced;         // latest frame resent to slow clients after catch-up
+};
+
+/*
+ * TCP telemetry publisher.
+ * serial reader thread puts frames into a single producer single consumer
+ * queue, publisher thread renders every frame once per wire mode and writes
+ * it to all connected clients with non-blocking sockets. A client which
+ * can't keep up skips frames and gets the latest one when its buffer drains.
+ *
+ * Right after connecting a client may send one option line, liked
+ * "mode=binary delta=1 rate=10\n". Frames are not sent until the line arrives or
+ * HS_PUBLISHER_NEGOTIATE_MS elapsed, so clients which send nothing keep
+ * receiving full json frames as before. Frames of that window are dropped,
+ * a client which sent options gets the latest frame right after the line.
+ */
+class HS_TelemetryPublisher {
+public:
+    HS_TelemetryPublisher(const char *address = HS_PUBLISHER_ADDRESS, int port = HS_PUBLISHER_PORT);
+    ~HS_TelemetryPublisher();
+    HS_TelemetryPublisher(HS_TelemetryPublisher const &) = delete;
+    HS_TelemetryPublisher &operator=(HS_TelemetryPublisher const &) = delete;
+
+    int start(void);
+    void stop(void);
+    void publish(const HS_TelemetryFrame &frame);
+    void getStats(HS_PublisherStats *stats) const;
+
+private:
+    struct Client {
+        int fd;
+        std::string out;
+        size_t out_off = 0;
+        bool want_latest = false;
+        bool writable_armed = false;
+        bool negotiated = false;
+        int mode = HS_WIRE_JSON;
+        uint64_t connected_ms = 0;
+        std::string in;
+        HS_TelemetryFilter filter;
+    };
+    struct Rendered;
+
+    static void* threadMain(void *arg);
+    void run(void);
+    int openListener(void);
+    void acceptClients(void);
+    void closeClient(Client *client);
+    void onReadable(Client *client);
+    void parseOptions(Client *client, const std::string &line);
+    bool isReady(Client *client, uint64_t now_ms);
+    void drainQueue(void);
+    void sendFrame(Client *client, const HS_TelemetryFrame &frame, Rendered &rendered);
+    bool flushClient(Client *client);
+    void armWritable(Client *client, bool enable);
+    void render(Client *client, const HS_TelemetryFrame &frame, Rendered &rendered,
+                unsigned int mask, const char **data, size_t *len);
+
+private:
+    std::string address;
+    int port;
+    int epfd = -1;
+    int listenfd = -1;
+    int wakefd = -1;
+    pthread_t tid;
+    bool started = false;
+    std::atomic<bool> running;
+
+    HS_TelemetryFrame queue[HS_PUBLISHER_QUEUE_SIZE];
+    std::atomic<size_t> queue_head;
+    std::atomic<size_t> queue_tail;
+    std::atomic<bool> wake_pending;
+
+    std::unordered_map<int, Client*> clients;
+    HS_TelemetryFrame latest;
+    bool have_latest = false;
+
+    std::atomic<uint32_t> client_count;
+    std::atomic<uint64_t> accepted;
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> queue_dropped;
+    std::atomic<uint64_t> client_dropped;
+    std::atomic<uint64_t> coalesced;
+};
+
+#endif // HOMESCREEN_PUBLISHER_H
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * client registry contention benchmark.
+ *
+ * runs HS_ClientManager against the afb and json-c simulators in sim/,
+ * hundreds of subscribed stub clients stay registered while lookup
+ * threads forward showWindow to one client, broadcast threads push
+ * application-list-changed to all of them and writer threads add and
+ * remove short lived clients through subscribe and session close.
+ * lookups and broadcasts read a registry snapshot, writers copy the map
+ * and publish it. latency is taken per operation.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <getopt.h>
+#include "hs-clientmanager.h"
+#include "hs-telemetry.h"
+#include "hs-stats.h"
+
+enum BenchOp {
+    BENCH_LOOKUP = 0,
+    BENCH_BROADCAST,
+    BENCH_ADD,
+    BENCH_REMOVE,
+    BENCH_OP_MAX
+};
+
+static const char *op_name[BENCH_OP_MAX] = {
+    "lookup",
+    "broadcast",
+    "add",
+    "remove"
+};
+
+struct BenchConfig {
+    unsigned int clients = 300;     // registered during the whole run
+    unsigned int lookups = 4;       // showWindow threads
+    unsigned int broadcasts = 1;    // application-list-changed threads
+    unsigned int writers = 2;       // add/remove threads
+    unsigned int seconds = 3;
+};
+
+// per thread samples, merged after the run
+struct BenchSamples {
+    std::vector<uint64_t> ns[BENCH_OP_MAX];
+};
+
+static BenchConfig config;
+static struct afb_api_x3 api = { "homescreen" };
+static std::atomic<bool> running {true};
+
+/**
+ * make a simulated session of appid and subscribe it
+ *
+ * #### Parameters
+ *  - appid : app's id
+ *
+ * #### Return
+ * the session, nullptr : subscribe failed
+ *
+ */
+static afb_req_t subscribeClient(const std::string &appid)
+{
+    afb_req_t req = new afb_req_x3();
+    req->api = &api;
+    req->appid = strdup(appid.c_str());
+    req->args = json_object_new_object();
+    json_object_object_add(req->args, "event", json_object_new_string("application-list-changed"));
+
+    HS_ReqCtxt ctxt(req, HS_VERB_SUBSCRIBE);
+    if(HS_ClientManager::instance()->handleRequest(ctxt, req->appid) != 0) {
+        fprintf(stderr, "subscribe %s failed\n", appid.c_str());
+        return nullptr;
+    }
+    return req;
+}
+
+/**
+ * close simulated session, afb releases the session context
+ *
+ * #### Parameters
+ *  - req : session from subscribeClient
+ *
+ * #### Return
+ * None
+ *
+ */
+static void closeClient(afb_req_t req)
+{
+    if(req->context_free != nullptr)
+        req->context_free(req->context);
+    json_object_put(req->args);
+    free((void*)req->appid);
+    delete req;
+}
+
+static void lookupMain(unsigned int index, BenchSamples *samples)
+{
+    struct afb_req_x3 req = { &api, nullptr, json_object_new_object(), nullptr, nullptr };
+    unsigned int n = index;
+    while(running.load(std::memory_order_relaxed)) {
+        std::string appid = "app" + std::to_string(n++ % config.clients);
+        HS_ReqCtxt ctxt(&req, HS_VERB_SHOW_WINDOW);
+        uint64_t start = HS_Telemetry::now();
+        HS_ClientManager::instance()->handleRequest(ctxt, appid.c_str());
+        samples->ns[BENCH_LOOKUP].push_back(HS_Telemetry::now() - start);
+    }
+    json_object_put(req.args);
+}
+
+static void broadcastMain(unsigned int index, BenchSamples *samples)
+{
+    (void)index;
+    while(running.load(std::memory_order_relaxed)) {
+        struct json_object *param = json_object_new_object();
+        json_object_object_add(param, "operation", json_object_new_string("install"));
+        json_object_object_add(param, "data", json_object_new_string("bench@0.1"));
+        uint64_t start = HS_Telemetry::now();
+        HS_ClientManager::instance()->pushEvent("application-list-changed", param);
+        samples->ns[BENCH_BROADCAST].push_back(HS_Telemetry::now() - start);
+        hs_sim_drain();     // keep the release queue short, not timed
+    }
+}
+
+static void writerMain(unsigned int index, BenchSamples *samples)
+{
+    unsigned int n = 0;
+    while(running.load(std::memory_order_relaxed)) {
+        std::string appid = "churn" + std::to_string(index) + "-" + std::to_string(n++ % 16);
+        uint64_t start = HS_Telemetry::now();
+        afb_req_t req = subscribeClient(appid);
+        uint64_t added = HS_Telemetry::now();
+        if(req == nullptr)
+            break;
+        samples->ns[BENCH_ADD].push_back(added - start);
+        closeClient(req);
+        samples->ns[BENCH_REMOVE].push_back(HS_Telemetry::now() - added);
+    }
+}
+
+static uint64_t percentile(std::vector<uint64_t> &v, double p)
+{
+    if(v.empty())
+        return 0;
+    size_t i = (size_t)(p * (v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "usage: %s [-c clients] [-l lookup_threads] [-b broadcast_threads] [-w writer_threads] [-d seconds]\n"
+        "  -c  registered clients (default 300)\n"
+        "  -l  threads forwarding showWindow to one client (default 4)\n"
+        "  -b  threads broadcasting application-list-changed (default 1)\n"
+        "  -w  threads adding and removing clients (default 2)\n"
+        "  -d  run time in seconds (default 3)\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while((opt = getopt(argc, argv, "c:l:b:w:d:h")) != -1) {
+        switch(opt) {
+        case 'c': config.clients = strtoul(optarg, NULL, 0); break;
+        case 'l': config.lookups = strtoul(optarg, NULL, 0); break;
+        case 'b': config.broadcasts = strtoul(optarg, NULL, 0); break;
+        case 'w': config.writers = strtoul(optarg, NULL, 0); break;
+        case 'd': config.seconds = strtoul(optarg, NULL, 0); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(config.clients == 0 || config.seconds == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<afb_req_t> sessions;
+    for(unsigned int i = 0; i < config.clients; ++i) {
+        afb_req_t req = subscribeClient("app" + std::to_string(i));
+        if(req == nullptr)
+            return 1;
+        sessions.push_back(req);
+    }
+
+    struct {
+        unsigned int count;
+        void (*func)(unsigned int, BenchSamples*);
+    } roles[] = {
+        { config.lookups, lookupMain },
+        { config.broadcasts, broadcastMain },
+        { config.writers, writerMain }
+    };
+    std::vector<std::unique_ptr<BenchSamples>> samples;
+    std::vector<std::thread> threads;
+    uint64_t start = HS_Telemetry::now();
+    for(auto &role : roles) {
+        for(unsigned int i = 0; i < role.count; ++i) {
+            samples.emplace_back(new BenchSamples());
+            threads.emplace_back(role.func, i, samples.back().get());
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(config.seconds));
+    running = false;
+    for(auto &t : threads)
+        t.join();
+    double seconds = (HS_Telemetry::now() - start) / 1e9;
+    hs_sim_drain();
+
+    printf("clients    : %u registered, %u lookup, %u broadcast, %u writer threads, %.3f s\n",
+           config.clients, config.lookups, config.broadcasts, config.writers, seconds);
+    for(int op = 0; op < BENCH_OP_MAX; ++op) {
+        std::vector<uint64_t> all;
+        for(auto &s : samples)
+            all.insert(all.end(), s->ns[op].begin(), s->ns[op].end());
+        if(all.empty())
+            continue;
+        printf("%-10s : %10.0f ops/s, latency us p50 %.2f p99 %.2f max %.2f\n",
+               op_name[op], all.size() / seconds, percentile(all, 0.50) / 1e3,
+               percentile(all, 0.99) / 1e3, percentile(all, 1.0) / 1e3);
+    }
+    printf("events     : %lu pushes\n", hs_sim_event_pushes());
+    HS_PoolStats clients, ctxts;
+    HS_ClientManager::instance()->getPoolStats(&clients, &ctxts);
+    printf("client pool: %llu slot allocs, %llu reuses, %llu slab allocs, peak %u\n",
+           (unsigned long long)clients.slot_allocs, (unsigned long long)clients.slot_reuses,
+           (unsigned long long)clients.slab_allocs, clients.peak);
+    HS_RegistryStats registry;
+    HS_ClientManager::instance()->getRegistryStats(&registry);
+    uint64_t churn = registry.adds + registry.removes;
+    printf("registry   : %llu adds, %llu removes, %llu heap allocs, %.1f per add/remove\n",
+           (unsigned long long)registry.adds, (unsigned long long)registry.removes,
+           (unsigned long long)registry.heap_allocs, churn ? (double)registry.heap_allocs / churn : 0.0);
+#ifdef HS_LOCK_STATS
+    struct json_object *locks = hs_lock_stats_to_json();
+    printf("locks      : %s\n", json_object_to_json_string(locks));
+    json_object_put(locks);
+#endif
+
+    for(auto req : sessions)
+        closeClient(req);
+    return 0;
+}
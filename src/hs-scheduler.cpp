@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "hs-scheduler.h"
+#include "hs-telemetry.h"
+#include "hs-log.h"
+
+#define NS_PER_MS   1000000ULL
+
+/**
+ * HS_Scheduler construction function
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_Scheduler::HS_Scheduler()
+    : running(false), wakeups(0), runs(0), jitter_max_ns(0), jitter_sum_ns(0)
+{
+    pthread_mutex_init(&mtx, NULL);
+}
+
+/**
+ * HS_Scheduler destruction function
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_Scheduler::~HS_Scheduler()
+{
+    stop();
+    pthread_mutex_destroy(&mtx);
+}
+
+/**
+ * get instance
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * HS_Scheduler instance pointer
+ *
+ */
+HS_Scheduler* HS_Scheduler::instance(void)
+{
+    static HS_Scheduler *me = new HS_Scheduler();
+    return me;
+}
+
+/**
+ * start scheduler thread
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * 0 : success
+ * -1 : fail
+ *
+ */
+int HS_Scheduler::start(void)
+{
+    if(started)
+        return 0;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(epfd < 0 || timerfd < 0 || wakefd < 0) {
+        HS_LOG_ERROR("scheduler epoll/timerfd/eventfd create failed(%s)", strerror(errno));
+        stop();
+        return -1;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = timerfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &ev);
+    ev.data.fd = wakefd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev);
+
+    pthread_mutex_lock(&mtx);
+    rearm();    // tasks may be added before start
+    pthread_mutex_unlock(&mtx);
+
+    running = true;
+    if(pthread_create(&tid, NULL, &HS_Scheduler::threadMain, this) != 0) {
+        running = false;
+        stop();
+        return -1;
+    }
+    started = true;
+    return 0;
+}
+
+/**
+ * stop scheduler thread, registered tasks are kept
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Scheduler::stop(void)
+{
+    if(started) {
+        running = false;
+        uint64_t one = 1;
+        ssize_t ret = write(wakefd, &one, sizeof(one));
+        (void)ret;
+        pthread_join(tid, NULL);
+        started = false;
+    }
+
+    if(timerfd >= 0) {
+        close(timerfd);
+        timerfd = -1;
+    }
+    if(wakefd >= 0) {
+        close(wakefd);
+        wakefd = -1;
+    }
+    if(epfd >= 0) {
+        close(epfd);
+        epfd = -1;
+    }
+}
+
+/**
+ * register task
+ *
+ * #### Parameters
+ *  - name : task name for log
+ *  - f : task function
+ *  - arg : argument of task function
+ *  - delay_ms : delay of first run
+ *  - period_ms : run interval, 0 : one-shot task which can be armed again by schedule
+ *
+ * #### Return
+ * task id
+ *
+ */
+int HS_Scheduler::addTask(const char *name, task_func f, void *arg, uint64_t delay_ms, uint64_t period_ms)
+{
+    Task task;
+    task.name = name;
+    task.f = f;
+    task.arg = arg;
+    task.period_ns = period_ms * NS_PER_MS;
+    task.deadline_ns = HS_Telemetry::now() + delay_ms * NS_PER_MS;
+    task.armed = true;
+
+    pthread_mutex_lock(&mtx);
+    int id = (int)tasks.size();
+    tasks.push_back(task);
+    rearm();
+    pthread_mutex_unlock(&mtx);
+    HS_LOG_DEBUG("scheduler task %s added, id=%d delay=%llu period=%llu", name, id,
+                 (unsigned long long)delay_ms, (unsigned long long)period_ms);
+    return id;
+}
+
+/**
+ * arm task to run after delay, replaces pending deadline
+ *
+ * #### Parameters
+ *  - id : task id
+ *  - delay_ms : delay
+ *
+ * #### Return
+ * 0 : success
+ * -1 : no such task
+ *
+ */
+int HS_Scheduler::schedule(int id, uint64_t delay_ms)
+{
+    int ret = -1;
+    pthread_mutex_lock(&mtx);
+    if(id >= 0 && id < (int)tasks.size()) {
+        tasks[id].deadline_ns = HS_Telemetry::now() + delay_ms * NS_PER_MS;
+        tasks[id].armed = true;
+        rearm();
+        ret = 0;
+    }
+    pthread_mutex_unlock(&mtx);
+    return ret;
+}
+
+/**
+ * disarm task, it can be armed again by schedule
+ *
+ * #### Parameters
+ *  - id : task id
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Scheduler::cancel(int id)
+{
+    pthread_mutex_lock(&mtx);
+    if(id >= 0 && id < (int)tasks.size()) {
+        tasks[id].armed = false;
+        rearm();
+    }
+    pthread_mutex_unlock(&mtx);
+}
+
+/**
+ * get scheduler statistics
+ *
+ * #### Parameters
+ *  - stats : [OUT] statistics
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Scheduler::getStats(HS_SchedulerStats *stats) const
+{
+    stats->wakeups = wakeups.load(std::memory_order_relaxed);
+    stats->runs = runs.load(std::memory_order_relaxed);
+    stats->jitter_max_us = jitter_max_ns.load(std::memory_order_relaxed) / 1000;
+    stats->jitter_avg_us = stats->runs ? jitter_sum_ns.load(std::memory_order_relaxed) / stats->runs / 1000 : 0;
+}
+
+void* HS_Scheduler::threadMain(void *arg)
+{
+    static_cast<HS_Scheduler*>(arg)->run();
+    return NULL;
+}
+
+/**
+ * arm timerfd to nearest deadline, called with mtx locked
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Scheduler::rearm(void)
+{
+    if(timerfd < 0)
+        return;
+
+    uint64_t nearest = 0;
+    for(auto &task : tasks) {
+        if(task.armed && (nearest == 0 || task.deadline_ns < nearest))
+            nearest = task.deadline_ns;
+    }
+
+    // zero it_value disarms timer when no task is armed
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if(nearest != 0) {
+        its.it_value.tv_sec = nearest / 1000000000ULL;
+        its.it_value.tv_nsec = nearest % 1000000000ULL;
+    }
+    timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/**
+ * run all tasks whose deadline passed, periodic tasks keep their phase
+ * and skip missed periods
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Scheduler::runDueTasks(void)
+{
+    std::vector<std::pair<task_func, void*>> due;
+    uint64_t now = HS_Telemetry::now();
+
+    pthread_mutex_lock(&mtx);
+    for(auto &task : tasks) {
+        if(!task.armed || task.deadline_ns > now)
+            continue;
+
+        uint64_t late = now - task.deadline_ns;
+        jitter_sum_ns.fetch_add(late, std::memory_order_relaxed);
+        if(late > jitter_max_ns.load(std::memory_order_relaxed))
+            jitter_max_ns.store(late, std::memory_order_relaxed);
+
+        if(task.period_ns != 0)
+            task.deadline_ns += task.period_ns * (late / task.period_ns + 1);
+        else
+            task.armed = false;
+        due.emplace_back(task.f, task.arg);
+    }
+    pthread_mutex_unlock(&mtx);
+
+    // run without lock, tasks may schedule again
+    for(auto &task : due)
+        task.first(task.second);
+    runs.fetch_add(due.size(), std::memory_order_relaxed);
+
+    pthread_mutex_lock(&mtx);
+    rearm();
+    pthread_mutex_unlock(&mtx);
+}
+
+/**
+ * scheduler thread main loop
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Scheduler::run(void)
+{
+    while(running) {
+        struct epoll_event events[2];
+        int n = epoll_wait(epfd, events, 2, -1);
+        if(n < 0) {
+            if(errno == EINTR)
+                continue;
+            HS_LOG_ERROR("scheduler epoll_wait failed(%s)", strerror(errno));
+            break;
+        }
+
+        wakeups.fetch_add(1, std::memory_order_relaxed);
+        for(int i = 0; i < n; ++i) {
+            uint64_t val;
+            ssize_t ret = read(events[i].data.fd, &val, sizeof(val));
+            (void)ret;
+        }
+        if(running)
+            runDueTasks();
+    }
+}
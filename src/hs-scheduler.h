@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOMESCREEN_SCHEDULER_H
+#define HOMESCREEN_SCHEDULER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+struct HS_SchedulerStats {
+    uint64_t wakeups;           // scheduler thread wakeups
+    uint64_t runs;              // task callbacks run
+    uint64_t jitter_max_us;     // worst delay of a run behind its deadline
+    uint64_t jitter_avg_us;
+};
+
+/*
+ * exponential backoff delay, doubles on every failure up to max_ms
+ */
+struct HS_Backoff {
+    HS_Backoff(uint64_t initial_ms, uint64_t max_ms) : initial_ms(initial_ms), max_ms(max_ms), cur_ms(initial_ms) {}
+    uint64_t next(void) {
+        uint64_t ret = cur_ms;
+        cur_ms = cur_ms * 2 > max_ms ? max_ms : cur_ms * 2;
+        return ret;
+    }
+    void reset(void) { cur_ms = initial_ms; }
+
+    uint64_t initial_ms;
+    uint64_t max_ms;
+    uint64_t cur_ms;
+};
+
+/*
+ * periodic and one-shot task scheduler.
+ * one thread sleeps on a timerfd armed to the nearest task deadline, so it
+ * only wakes when a task is due. Tasks run in scheduler thread and must not
+ * block, they may call schedule/cancel on any task including themselves.
+ */
+class HS_Scheduler {
+public:
+    typedef void (*task_func)(void *arg);
+
+    HS_Scheduler();
+    ~HS_Scheduler();
+    HS_Scheduler(HS_Scheduler const &) = delete;
+    HS_Scheduler &operator=(HS_Scheduler const &) = delete;
+
+    static HS_Scheduler* instance(void);
+    int start(void);
+    void stop(void);
+    int addTask(const char *name, task_func f, void *arg, uint64_t delay_ms, uint64_t period_ms = 0);
+    int schedule(int id, uint64_t delay_ms);
+    void cancel(int id);
+    void getStats(HS_SchedulerStats *stats) const;
+
+private:
+    struct Task {
+        std::string name;
+        task_func f;
+        void *arg;
+        uint64_t period_ns;     // 0 : one-shot
+        uint64_t deadline_ns;
+        bool armed;
+    };
+
+    static void* threadMain(void *arg);
+    void run(void);
+    void runDueTasks(void);
+    void rearm(void);
+
+private:
+    std::vector<Task> tasks;    // task id is index
+    pthread_mutex_t mtx;
+    pthread_t tid;
+    bool started = false;
+    std::atomic<bool> running;
+    int epfd = -1;
+    int timerfd = -1;
+    int wakefd = -1;
+
+    std::atomic<uint64_t> wakeups;
+    std::atomic<uint64_t> runs;
+    std::atomic<uint64_t> jitter_max_ns;
+    std::atomic<uint64_t> jitter_sum_ns;
+};
+
+#endif // HOMESCREEN_SCHEDULER_H
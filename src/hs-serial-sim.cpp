@@ -0,0 +1,456 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * serial simulator and telemetry path benchmark.
+ *
+ * creates a pty pair, runs HS_SerialReader on the slave side and the TCP
+ * publisher behind it, then writes synthetic or recorded A5 5A frames to
+ * the master side at a fixed rate. A binary mode TCP client measures
+ * latency from write to reception, CPU time is taken per thread.
+ *
+ * synthetic frames carry the frame index in 4 extra data bytes, 7 bits
+ * each, so latency can be matched even when noise frames are injected.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pty.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "hs-serial.h"
+#include "hs-telemetry.h"
+#include "hs-publisher.h"
+#include "hs-log.h"
+
+#define SIM_ADDRESS         "127.0.0.1"
+#define SIM_PORT            15000
+#define SIM_INDEX_OFFSET    (MESSAGE_PREFIX_LENGTH + 5)     // after 5 telemetry bytes
+#define SIM_DATA_LENGTH     9
+#define SIM_FRAME_LENGTH    (MESSAGE_PREFIX_LENGTH + SIM_DATA_LENGTH + MESSAGE_SUFFIX_LENGTH)
+#define SIM_DRAIN_MS        500
+
+struct SimConfig {
+    unsigned int rate = 1000;       // frames per second, 0 : as fast as possible
+    unsigned int count = 10000;
+    unsigned int bad_crc = 0;       // percent of frames with broken crc
+    unsigned int truncated = 0;     // percent of frames cut short
+    const char *file = nullptr;     // recorded raw frames
+    int port = SIM_PORT;
+};
+
+struct SimFrame {
+    std::vector<unsigned char> bytes;
+    int index;                      // -1 : noise, not expected to arrive
+};
+
+static SimConfig config;
+static HS_TelemetryPublisher *publisher = nullptr;
+
+// written by reader thread before publish, read by client after reception
+static std::vector<int> seq_to_index;
+static std::vector<uint64_t> send_ns;
+static std::atomic<uint64_t> parsed {0};
+static std::atomic<uint64_t> unexpected {0};
+static std::atomic<bool> client_done {false};
+
+static std::vector<uint64_t> latencies;
+static uint64_t received = 0;
+static uint64_t writer_cpu_ns = 0;
+static uint64_t client_cpu_ns = 0;
+
+static uint64_t thread_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t process_cpu_ns(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ((uint64_t)ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL
+         + ((uint64_t)ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL;
+}
+
+static void onFrame(void *arg, uint64_t timestamp, const unsigned char *frame, int length)
+{
+    (void)arg;
+    uint64_t seq = parsed.fetch_add(1, std::memory_order_relaxed);
+    int index = -1;
+    if(config.file == nullptr && length == SIM_FRAME_LENGTH) {
+        const unsigned char *p = frame + SIM_INDEX_OFFSET;
+        index = p[0] | p[1] << 7 | p[2] << 14 | p[3] << 21;
+        if(index >= (int)send_ns.size())
+            index = -1;
+    }
+    else if(config.file != nullptr) {
+        index = (int)seq;   // recorded frames are expected to be valid and in order
+    }
+    if(index < 0)
+        unexpected.fetch_add(1, std::memory_order_relaxed);
+    if(seq < seq_to_index.size())
+        seq_to_index[seq] = index;
+
+    HS_TelemetryFrame decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    if(HS_Telemetry::decode(frame, length, &decoded)) {
+        decoded.timestamp = timestamp;
+        HS_Telemetry::instance()->publish(decoded);
+    }
+}
+
+static void onTelemetry(const HS_TelemetryFrame &frame)
+{
+    publisher->publish(frame);
+}
+
+/**
+ * build synthetic frames, data bytes never contain MESSAGE_HEADER_01 so
+ * noise can't hide a following good frame
+ *
+ * #### Parameters
+ *  - frames : [OUT] frames to send
+ *
+ * #### Return
+ * number of good frames
+ *
+ */
+static int buildSynthetic(std::vector<SimFrame> &frames)
+{
+    int good = 0;
+    for(unsigned int i = 0; i < config.count; ++i) {
+        SimFrame f;
+        unsigned char data[SIM_DATA_LENGTH];
+        data[0] = (unsigned char)(i % 200);         // odo
+        data[1] = (unsigned char)(i % 120);         // curSpeed
+        data[2] = (unsigned char)(100 - i % 100);   // batteryLev
+        data[3] = (unsigned char)((i / 50) & 1);    // signalLightLeft
+        data[4] = (unsigned char)((i / 70) & 1);    // signalLightRight
+        for(int k = 0; k < 4; ++k)
+            data[5 + k] = (unsigned char)((good >> (7 * k)) & 0x7F);   // 7 bits per byte
+        for(int k = 0; k < 5; ++k) {
+            if(data[k] == MESSAGE_HEADER_01)
+                data[k] = 0;
+        }
+
+        f.bytes.push_back(MESSAGE_HEADER_01);
+        f.bytes.push_back(MESSAGE_HEADER_02);
+        f.bytes.push_back(SIM_DATA_LENGTH);
+        f.bytes.insert(f.bytes.end(), data, data + SIM_DATA_LENGTH);
+        f.bytes.push_back(hs_serial_crc8(&f.bytes[2], SIM_DATA_LENGTH + 1));
+        f.index = good;
+
+        unsigned int dice = (unsigned int)rand() % 100;
+        if(dice < config.bad_crc) {
+            f.bytes.back() ^= 0x5A;
+            f.index = -1;
+        }
+        else if(dice < config.bad_crc + config.truncated) {
+            f.bytes.resize(MESSAGE_PREFIX_LENGTH + 1 + (unsigned int)rand() % (SIM_DATA_LENGTH - 1));
+            f.index = -1;
+        }
+        else {
+            ++good;
+        }
+        frames.push_back(std::move(f));
+    }
+    return good;
+}
+
+/**
+ * load recorded raw frames, bytes between frames are kept as they are
+ *
+ * #### Parameters
+ *  - frames : [OUT] frames to send
+ *
+ * #### Return
+ * number of frames, -1 : fail
+ *
+ */
+static int loadRecorded(std::vector<SimFrame> &frames)
+{
+    FILE *fp = fopen(config.file, "rb");
+    if(fp == nullptr) {
+        fprintf(stderr, "can't open %s(%s)\n", config.file, strerror(errno));
+        return -1;
+    }
+    std::vector<unsigned char> raw;
+    unsigned char buf[4096];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        raw.insert(raw.end(), buf, buf + n);
+    fclose(fp);
+
+    int count = 0;
+    size_t pos = 0;
+    while(pos < raw.size()) {
+        size_t end = pos + 1;
+        if(raw[pos] == MESSAGE_HEADER_01 && pos + MESSAGE_PREFIX_LENGTH <= raw.size()
+        && raw[pos + 1] == MESSAGE_HEADER_02) {
+            end = std::min(raw.size(), pos + MESSAGE_PREFIX_LENGTH + raw[pos + 2] + MESSAGE_SUFFIX_LENGTH);
+        }
+        SimFrame f;
+        f.bytes.assign(raw.begin() + pos, raw.begin() + end);
+        f.index = (end - pos > 1) ? count++ : -1;
+        frames.push_back(std::move(f));
+        pos = end;
+    }
+    return count;
+}
+
+/**
+ * write frames to pty master at configured rate
+ *
+ * #### Parameters
+ *  - master : pty master fd
+ *  - frames : frames to send
+ *
+ * #### Return
+ * None
+ *
+ */
+static void writeFrames(int master, const std::vector<SimFrame> &frames)
+{
+    uint64_t cpu_start = thread_cpu_ns();
+    uint64_t start = HS_Telemetry::now();
+    std::vector<unsigned char> batch;
+    size_t next = 0;
+    while(next < frames.size()) {
+        uint64_t now = HS_Telemetry::now();
+        size_t due = frames.size();
+        if(config.rate != 0)
+            due = std::min(due, (size_t)((now - start) * config.rate / 1000000000ULL) + 1);
+        if(due <= next) {
+            uint64_t wake = start + (uint64_t)next * 1000000000ULL / config.rate;
+            struct timespec ts;
+            ts.tv_sec = wake / 1000000000ULL;
+            ts.tv_nsec = wake % 1000000000ULL;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            continue;
+        }
+
+        batch.clear();
+        for(; next < due; ++next) {
+            const SimFrame &f = frames[next];
+            if(f.index >= 0)
+                send_ns[f.index] = now;
+            batch.insert(batch.end(), f.bytes.begin(), f.bytes.end());
+            if(batch.size() >= 4096) {
+                ++next;
+                break;
+            }
+        }
+        for(size_t off = 0; off < batch.size(); ) {
+            ssize_t n = write(master, batch.data() + off, batch.size() - off);
+            if(n < 0 && errno != EINTR) {
+                fprintf(stderr, "pty write failed(%s)\n", strerror(errno));
+                return;
+            }
+            if(n > 0)
+                off += n;
+        }
+    }
+    writer_cpu_ns = thread_cpu_ns() - cpu_start;
+}
+
+static void* clientMain(void *arg)
+{
+    (void)arg;
+    uint64_t cpu_start = thread_cpu_ns();
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config.port);
+    addr.sin_addr.s_addr = inet_addr(SIM_ADDRESS);
+    for(int retry = 0; connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0; ++retry) {
+        if(retry > 50) {
+            fprintf(stderr, "can't connect publisher(%s)\n", strerror(errno));
+            close(fd);
+            return NULL;
+        }
+        usleep(20000);
+    }
+    const char option[] = "mode=binary\n";
+    if(send(fd, option, sizeof(option) - 1, 0) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    struct timeval tv = {0, 100000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    std::vector<unsigned char> in;
+    unsigned char buf[16384];
+    while(!client_done) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if(n == 0)
+            break;
+        if(n < 0)
+            continue;
+        uint64_t now = HS_Telemetry::now();
+        in.insert(in.end(), buf, buf + n);
+
+        size_t off = 0;
+        HS_TelemetryFrame frame;
+        int ret;
+        while((ret = hs_telemetry_decode(in.data() + off, in.size() - off, &frame)) > 0) {
+            off += ret;
+            ++received;
+            if(frame.seq < seq_to_index.size() && seq_to_index[frame.seq] >= 0)
+                latencies.push_back(now - send_ns[seq_to_index[frame.seq]]);
+        }
+        if(ret < 0) {
+            fprintf(stderr, "broken record from publisher\n");
+            break;
+        }
+        in.erase(in.begin(), in.begin() + off);
+    }
+    close(fd);
+    client_cpu_ns = thread_cpu_ns() - cpu_start;
+    return NULL;
+}
+
+static uint64_t percentile(std::vector<uint64_t> &v, double p)
+{
+    if(v.empty())
+        return 0;
+    size_t i = (size_t)(p * (v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "usage: %s [-r rate] [-n count] [-c bad_crc%%] [-t truncated%%] [-f recorded.bin] [-p port]\n"
+        "  -r  frames per second, 0 : as fast as possible (default 1000)\n"
+        "  -n  number of synthetic frames (default 10000)\n"
+        "  -c  percent of frames sent with broken crc\n"
+        "  -t  percent of frames sent truncated\n"
+        "  -f  replay raw bytes captured from the serial port instead\n"
+        "  -p  publisher port (default %d)\n", name, SIM_PORT);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while((opt = getopt(argc, argv, "r:n:c:t:f:p:h")) != -1) {
+        switch(opt) {
+        case 'r': config.rate = strtoul(optarg, NULL, 0); break;
+        case 'n': config.count = strtoul(optarg, NULL, 0); break;
+        case 'c': config.bad_crc = strtoul(optarg, NULL, 0); break;
+        case 't': config.truncated = strtoul(optarg, NULL, 0); break;
+        case 'f': config.file = optarg; break;
+        case 'p': config.port = atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if(config.bad_crc + config.truncated > 100 || config.count >= (1u << 28)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if(getenv("HS_LOG_LEVEL") == nullptr)
+        HS_Logger::instance()->setLevel(HS_LOGLEVEL_WARNING);
+
+    std::vector<SimFrame> frames;
+    int good = config.file ? loadRecorded(frames) : buildSynthetic(frames);
+    if(good < 0)
+        return 1;
+    send_ns.assign(good, 0);
+    seq_to_index.assign(frames.size() + 1, -1);
+
+    int master, slave;
+    char name[64];
+    if(openpty(&master, &slave, name, NULL, NULL) < 0) {
+        fprintf(stderr, "openpty failed(%s)\n", strerror(errno));
+        return 1;
+    }
+
+    publisher = new HS_TelemetryPublisher(SIM_ADDRESS, config.port);
+    publisher->start();
+    HS_Telemetry::instance()->addListener(onTelemetry);
+    HS_SerialReader reader(name, onFrame);
+    reader.start();
+
+    HS_SerialStats stats;
+    do {
+        usleep(10000);
+        reader.getStats(&stats);
+    } while(stats.state != HS_SERIAL_CONNECTED);
+
+    pthread_t client;
+    pthread_create(&client, NULL, clientMain, NULL);
+    usleep((HS_PUBLISHER_NEGOTIATE_MS + 100) * 1000);   // let client negotiate
+
+    uint64_t cpu_start = process_cpu_ns();
+    uint64_t start = HS_Telemetry::now();
+    writeFrames(master, frames);
+    uint64_t sent_ns = HS_Telemetry::now() - start;
+
+    // wait until parser stops making progress
+    uint64_t last = 0;
+    do {
+        last = parsed.load();
+        usleep(SIM_DRAIN_MS * 1000);
+    } while(parsed.load() != last);
+    uint64_t elapsed_ns = HS_Telemetry::now() - start - SIM_DRAIN_MS * 1000000ULL;
+    client_done = true;
+    pthread_join(client, NULL);
+    uint64_t cpu_ns = process_cpu_ns() - cpu_start;
+
+    HS_PublisherStats pub;
+    reader.getStats(&stats);
+    publisher->getStats(&pub);
+    reader.stop();
+    publisher->stop();
+    close(master);
+    close(slave);
+
+    // reader and publisher threads only, writer and client cost is excluded
+    uint64_t pipeline_ns = cpu_ns > writer_cpu_ns + client_cpu_ns ? cpu_ns - writer_cpu_ns - client_cpu_ns : 0;
+    double seconds = elapsed_ns / 1e9;
+    printf("sent       : %zu frames (%d good) in %.3f s\n", frames.size(), good, sent_ns / 1e9);
+    printf("parser     : %llu frames, %llu bad crc, %llu resyncs, %llu skipped bytes, %llu unexpected\n",
+           (unsigned long long)stats.frames, (unsigned long long)stats.bad_crc,
+           (unsigned long long)stats.resyncs, (unsigned long long)stats.skipped,
+           (unsigned long long)unexpected.load());
+    printf("throughput : %.0f frames/s, %.0f bytes/s\n", stats.frames / seconds, stats.bytes / seconds);
+    printf("publisher  : %llu frames, %llu queue dropped, %llu client dropped\n",
+           (unsigned long long)pub.frames, (unsigned long long)pub.queue_dropped,
+           (unsigned long long)pub.client_dropped);
+    printf("client     : %llu records, %zu matched\n", (unsigned long long)received, latencies.size());
+    printf("latency us : p50 %.1f p99 %.1f max %.1f\n",
+           percentile(latencies, 0.5) / 1e3, percentile(latencies, 0.99) / 1e3,
+           percentile(latencies, 1.0) / 1e3);
+    printf("cpu        : %.2f us/frame in reader and publisher, %.1f%% of one core\n",
+           stats.frames ? pipeline_ns / 1e3 / stats.frames : 0.0, pipeline_ns * 100.0 / elapsed_ns);
+    return 0;
+}
@@ -0,0 +1,687 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <libgen.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include "hs-serial.h"
+#include "hs-scheduler.h"
+#include "hs-log.h"
+
+#define RING_BUFFER_SIZE   4096
+#define REOPEN_MIN_MS      100
+#define REOPEN_MAX_MS      30000     // fallback only, hot-plug is seen by inotify
+
+// crc-8 table of CRC_POLYNOMIAL
+static const unsigned char crc8_table[256] = {
+    0x00, 0x31, 0x62, 0x53, 0xC4, 0xF5, 0xA6, 0x97,
+    0xB9, 0x88, 0xDB, 0xEA, 0x7D, 0x4C, 0x1F, 0x2E,
+    0x43, 0x72, 0x21, 0x10, 0x87, 0xB6, 0xE5, 0xD4,
+    0xFA, 0xCB, 0x98, 0xA9, 0x3E, 0x0F, 0x5C, 0x6D,
+    0x86, 0xB7, 0xE4, 0xD5, 0x42, 0x73, 0x20, 0x11,
+    0x3F, 0x0E, 0x5D, 0x6C, 0xFB, 0xCA, 0x99, 0xA8,
+    0xC5, 0xF4, 0xA7, 0x96, 0x01, 0x30, 0x63, 0x52,
+    0x7C, 0x4D, 0x1E, 0x2F, 0xB8, 0x89, 0xDA, 0xEB,
+    0x3D, 0x0C, 0x5F, 0x6E, 0xF9, 0xC8, 0x9B, 0xAA,
+    0x84, 0xB5, 0xE6, 0xD7, 0x40, 0x71, 0x22, 0x13,
+    0x7E, 0x4F, 0x1C, 0x2D, 0xBA, 0x8B, 0xD8, 0xE9,
+    0xC7, 0xF6, 0xA5, 0x94, 0x03, 0x32, 0x61, 0x50,
+    0xBB, 0x8A, 0xD9, 0xE8, 0x7F, 0x4E, 0x1D, 0x2C,
+    0x02, 0x33, 0x60, 0x51, 0xC6, 0xF7, 0xA4, 0x95,
+    0xF8, 0xC9, 0x9A, 0xAB, 0x3C, 0x0D, 0x5E, 0x6F,
+    0x41, 0x70, 0x23, 0x12, 0x85, 0xB4, 0xE7, 0xD6,
+    0x7A, 0x4B, 0x18, 0x29, 0xBE, 0x8F, 0xDC, 0xED,
+    0xC3, 0xF2, 0xA1, 0x90, 0x07, 0x36, 0x65, 0x54,
+    0x39, 0x08, 0x5B, 0x6A, 0xFD, 0xCC, 0x9F, 0xAE,
+    0x80, 0xB1, 0xE2, 0xD3, 0x44, 0x75, 0x26, 0x17,
+    0xFC, 0xCD, 0x9E, 0xAF, 0x38, 0x09, 0x5A, 0x6B,
+    0x45, 0x74, 0x27, 0x16, 0x81, 0xB0, 0xE3, 0xD2,
+    0xBF, 0x8E, 0xDD, 0xEC, 0x7B, 0x4A, 0x19, 0x28,
+    0x06, 0x37, 0x64, 0x55, 0xC2, 0xF3, 0xA0, 0x91,
+    0x47, 0x76, 0x25, 0x14, 0x83, 0xB2, 0xE1, 0xD0,
+    0xFE, 0xCF, 0x9C, 0xAD, 0x3A, 0x0B, 0x58, 0x69,
+    0x04, 0x35, 0x66, 0x57, 0xC0, 0xF1, 0xA2, 0x93,
+    0xBD, 0x8C, 0xDF, 0xEE, 0x79, 0x48, 0x1B, 0x2A,
+    0xC1, 0xF0, 0xA3, 0x92, 0x05, 0x34, 0x67, 0x56,
+    0x78, 0x49, 0x1A, 0x2B, 0xBC, 0x8D, 0xDE, 0xEF,
+    0x82, 0xB3, 0xE0, 0xD1, 0x46, 0x77, 0x24, 0x15,
+    0x3B, 0x0A, 0x59, 0x68, 0xFF, 0xCE, 0x9D, 0xAC
+};
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t monotonic_ms(void)
+{
+    return monotonic_ns() / 1000000;
+}
+
+/**
+ * HS_RingBuffer construction function
+ *
+ * #### Parameters
+ *  - capacity : buffer size, power of two
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_RingBuffer::HS_RingBuffer(size_t capacity) : cap(capacity), mask(capacity - 1)
+{
+    buf = new unsigned char[cap];
+}
+
+/**
+ * HS_RingBuffer destruction function
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_RingBuffer::~HS_RingBuffer()
+{
+    delete[] buf;
+}
+
+/**
+ * get contiguous writable area
+ *
+ * #### Parameters
+ *  - len : [OUT] writable length from returned pointer
+ *
+ * #### Return
+ * write position
+ *
+ */
+unsigned char* HS_RingBuffer::writePtr(size_t *len)
+{
+    size_t pos = tail & mask;
+    size_t contiguous = cap - pos;
+    size_t free_len = space();
+    *len = free_len < contiguous ? free_len : contiguous;
+    return buf + pos;
+}
+
+/**
+ * copy buffered bytes without consuming them
+ *
+ * #### Parameters
+ *  - offset : offset from read position
+ *  - dst : destination
+ *  - len : copy length
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_RingBuffer::copyOut(size_t offset, unsigned char *dst, size_t len) const
+{
+    size_t pos = (head + offset) & mask;
+    size_t first = cap - pos;
+    if(first >= len) {
+        memcpy(dst, buf + pos, len);
+    }
+    else {
+        memcpy(dst, buf + pos, first);
+        memcpy(dst + first, buf, len - first);
+    }
+}
+
+/**
+ * find byte in buffered data
+ *
+ * #### Parameters
+ *  - c : byte to find
+ *  - offset : offset from read position to start
+ *
+ * #### Return
+ * offset of found byte, size() : not found
+ *
+ */
+size_t HS_RingBuffer::find(unsigned char c, size_t offset) const
+{
+    size_t len = size();
+    while(offset < len) {
+        size_t pos = (head + offset) & mask;
+        size_t contiguous = cap - pos;
+        size_t n = len - offset < contiguous ? len - offset : contiguous;
+        const void *p = memchr(buf + pos, c, n);
+        if(p != nullptr)
+            return offset + ((const unsigned char*)p - (buf + pos));
+        offset += n;
+    }
+    return len;
+}
+
+/**
+ * calculate crc-8 of CRC_POLYNOMIAL
+ *
+ * #### Parameters
+ *  - data : data
+ *  - len : data length
+ *
+ * #### Return
+ * crc
+ *
+ */
+unsigned char hs_serial_crc8(const unsigned char *data, size_t len)
+{
+    unsigned char crc = CRC_INIT;
+    for(size_t i = 0; i < len; ++i)
+        crc = crc8_table[crc ^ data[i]];
+    return crc;
+}
+
+/**
+ * HS_SerialReader construction function
+ *
+ * #### Parameters
+ *  - device : serial device path, liked "/dev/ttyUSB0"
+ *  - handler : called in reader thread with every complete frame
+ *  - arg : first argument of handler
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_SerialReader::HS_SerialReader(const char *device, frame_handler handler, void *arg)
+    : device(device), handler(handler), handler_arg(arg), ring(RING_BUFFER_SIZE),
+      running(false), state(HS_SERIAL_STOPPED), busy_since(HS_SERIAL_IDLE), reconnects(0), open_failures(0), total_bytes(0), total_frames(0), bad_crc(0), resyncs(0), skipped(0),
+      bytes_per_sec(0), frames_per_sec(0)
+{
+    std::string path = device;
+    device_name = basename(&path[0]);
+    path = device;
+    device_dir = dirname(&path[0]);
+    pthread_mutex_init(&port_mtx, NULL);
+}
+
+/**
+ * HS_SerialReader destruction function
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_SerialReader::~HS_SerialReader()
+{
+    stop();
+    pthread_mutex_destroy(&port_mtx);
+}
+
+/**
+ * start reader thread
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * 0 : success
+ * -1 : fail
+ *
+ */
+int HS_SerialReader::start(void)
+{
+    if(started)
+        return 0;
+
+    wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(wakefd < 0) {
+        HS_LOG_ERROR("HS_SerialReader eventfd failed");
+        return -1;
+    }
+
+    // without inotify the reader still reopens by backoff
+    inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotifyfd < 0)
+        HS_LOG_WARNING("HS_SerialReader inotify failed(%s)", strerror(errno));
+
+    last_rate_ms = monotonic_ms();
+    running = true;
+    if(pthread_create(&tid, NULL, &HS_SerialReader::threadMain, this) != 0) {
+        running = false;
+        close(wakefd);
+        wakefd = -1;
+        if(inotifyfd >= 0) {
+            close(inotifyfd);
+            inotifyfd = -1;
+        }
+        return -1;
+    }
+    started = true;
+    return 0;
+}
+
+/**
+ * stop reader thread and close port
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_SerialReader::stop(void)
+{
+    if(!started)
+        return;
+
+    running = false;
+    uint64_t one = 1;
+    if(::write(wakefd, &one, sizeof(one)) < 0)
+        HS_LOG_ERROR("HS_SerialReader wakeup failed");
+    pthread_join(tid, NULL);
+    close(wakefd);
+    wakefd = -1;
+    if(inotifyfd >= 0) {
+        close(inotifyfd);
+        inotifyfd = -1;
+        watchfd = -1;
+    }
+    state = HS_SERIAL_STOPPED;
+    started = false;
+}
+
+/**
+ * write data to serial port, used by heartbeat
+ *
+ * #### Parameters
+ *  - data : data to write
+ *  - len : data length
+ *
+ * #### Return
+ * written length, -1 : fail
+ *
+ */
+int HS_SerialReader::write(const void *data, size_t len)
+{
+    int ret = -1;
+    pthread_mutex_lock(&port_mtx);
+    if(fd >= 0)
+        ret = ::write(fd, data, len);
+    pthread_mutex_unlock(&port_mtx);
+    return ret;
+}
+
+/**
+ * get receive statistics
+ *
+ * #### Parameters
+ *  - stats : [OUT] statistics
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_SerialReader::getStats(HS_SerialStats *stats) const
+{
+    stats->state = state.load(std::memory_order_relaxed);
+    stats->reconnects = reconnects.load(std::memory_order_relaxed);
+    stats->open_failures = open_failures.load(std::memory_order_relaxed);
+    stats->bytes = total_bytes.load(std::memory_order_relaxed);
+    stats->frames = total_frames.load(std::memory_order_relaxed);
+    stats->bad_crc = bad_crc.load(std::memory_order_relaxed);
+    stats->resyncs = resyncs.load(std::memory_order_relaxed);
+    stats->skipped = skipped.load(std::memory_order_relaxed);
+    stats->bytes_per_sec = bytes_per_sec.load(std::memory_order_relaxed);
+    stats->frames_per_sec = frames_per_sec.load(std::memory_order_relaxed);
+    stats->queue_dropped = 0;
+}
+
+void* HS_SerialReader::threadMain(void *arg)
+{
+    static_cast<HS_SerialReader*>(arg)->run();
+    return NULL;
+}
+
+/**
+ * open and configure serial port, 115200 8N1 raw, non-blocking
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * opened fd, -1 : fail
+ *
+ */
+int HS_SerialReader::openPort(void)
+{
+    int serialfd = open(device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if(serialfd < 0) {
+        return -1;
+    }
+
+    struct termios tty;
+    memset(&tty, 0, sizeof tty);
+    if(tcgetattr(serialfd, &tty) != 0) {
+        HS_LOG_ERROR("%s tcgetattr failed", device.c_str());
+        close(serialfd);
+        return -1;
+    }
+
+    /* Make raw, 8n1, no flow control */
+    cfmakeraw(&tty);
+    tty.c_cflag     &=  ~PARENB;
+    tty.c_cflag     &=  ~CSTOPB;
+    tty.c_cflag     &=  ~CSIZE;
+    tty.c_cflag     |=  CS8;
+    tty.c_cflag     &=  ~CRTSCTS;
+    tty.c_cflag     |=  CREAD | CLOCAL;     // turn on READ & ignore ctrl lines
+    tty.c_cc[VMIN]   =  1;
+    tty.c_cc[VTIME]  =  0;
+    cfsetospeed(&tty, (speed_t)B115200);
+    cfsetispeed(&tty, (speed_t)B115200);
+
+    /* Flush Port, then applies attributes */
+    tcflush(serialfd, TCIOFLUSH);
+    if(tcsetattr(serialfd, TCSANOW, &tty) != 0) {
+        HS_LOG_ERROR("%s tcsetattr failed", device.c_str());
+        close(serialfd);
+        return -1;
+    }
+    return serialfd;
+}
+
+/**
+ * close serial port
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_SerialReader::closePort(void)
+{
+    pthread_mutex_lock(&port_mtx);
+    if(fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    pthread_mutex_unlock(&port_mtx);
+    ring.clear();
+}
+
+/**
+ * read all available bytes into ring buffer
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * 0 : success
+ * -1 : port error, need reopen
+ *
+ */
+int HS_SerialReader::readChunk(void)
+{
+    while(ring.space() > 0) {
+        size_t len;
+        unsigned char *p = ring.writePtr(&len);
+        ssize_t n = read(fd, p, len);
+        if(n > 0) {
+            ring.commit(n);
+            total_bytes.fetch_add(n, std::memory_order_relaxed);
+            if((size_t)n < len)
+                break;
+        }
+        else if(n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            break;
+        }
+        else {
+            return -1;  // EOF or device error (unplugged)
+        }
+    }
+    return 0;
+}
+
+/**
+ * parse buffered bytes, frame is
+ * MESSAGE_HEADER_01 MESSAGE_HEADER_02 length data[length] crc
+ * frames with bad length or crc are dropped and parser resynchronises
+ * on the next MESSAGE_HEADER_01 after the rejected header
+ *
+ * #### Parameters
+ *  - timestamp : arrival time of the last read chunk
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_SerialReader::parseFrames(uint64_t timestamp)
+{
+    while(ring.size() >= MESSAGE_PREFIX_LENGTH) {
+        if(ring.peek(0) != MESSAGE_HEADER_01 || ring.peek(1) != MESSAGE_HEADER_02) {
+            resync(ring.peek(0) == MESSAGE_HEADER_01 ? 1 : 0);
+            continue;
+        }
+
+        size_t length = ring.peek(2);
+        if(length > MESSAGE_MAX_DATA_LENGTH) {
+            resync(1);
+            continue;
+        }
+        size_t total = MESSAGE_PREFIX_LENGTH + length + MESSAGE_SUFFIX_LENGTH;
+        if(ring.size() < total)
+            break;  // wait for the rest of frame
+
+        ring.copyOut(0, frame, total);
+        if(hs_serial_crc8(frame + 2, length + 1) != frame[total - 1]) {
+            bad_crc.fetch_add(1, std::memory_order_relaxed);
+            resync(1);
+            continue;
+        }
+
+        ring.consume(total);
+        total_frames.fetch_add(1, std::memory_order_relaxed);
+        if(handler)
+            handler(handler_arg, timestamp, frame, (int)total);
+    }
+}
+
+/**
+ * drop bytes up to next MESSAGE_HEADER_01
+ *
+ * #### Parameters
+ *  - from : offset to start searching, bytes before it are dropped
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_SerialReader::resync(size_t from)
+{
+    size_t pos = ring.find(MESSAGE_HEADER_01, from);
+    ring.consume(pos);
+    resyncs.fetch_add(1, std::memory_order_relaxed);
+    skipped.fetch_add(pos, std::memory_order_relaxed);
+}
+
+/**
+ * update bytes/sec and frames/sec over the time since last call,
+ * called periodically from one thread, liked the scheduler stats task
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_SerialReader::updateRate(void)
+{
+    uint64_t now = monotonic_ms();
+    uint64_t elapsed = now - last_rate_ms;
+    if(elapsed == 0)
+        return;
+
+    uint64_t bytes = total_bytes.load(std::memory_order_relaxed);
+    uint64_t frames = total_frames.load(std::memory_order_relaxed);
+    bytes_per_sec.store((uint32_t)((bytes - last_bytes) * 1000 / elapsed), std::memory_order_relaxed);
+    frames_per_sec.store((uint32_t)((frames - last_frames) * 1000 / elapsed), std::memory_order_relaxed);
+    last_bytes = bytes;
+    last_frames = frames;
+    last_rate_ms = now;
+}
+
+/**
+ * wait until device node appears, stop is requested or timeout,
+ * watch is added lazily since directory liked /dev/serial/by-id only
+ * exists while an adapter is plugged
+ *
+ * #### Parameters
+ *  - timeout_ms : retry timeout
+ *
+ * #### Return
+ * true : device node was created or changed
+ * false : timeout or stop, events of other nodes don't end the wait
+ *
+ */
+bool HS_SerialReader::waitForDevice(int timeout_ms)
+{
+    uint64_t deadline = monotonic_ms() + timeout_ms;
+    bool dir_missing = false;
+    for(;;) {
+        if(inotifyfd >= 0 && watchfd < 0) {
+            watchfd = inotify_add_watch(inotifyfd, device_dir.c_str(), IN_CREATE | IN_ATTRIB | IN_MOVED_TO);
+            if(watchfd >= 0 && dir_missing)
+                return true;    // directory appeared, device may already be in it
+            dir_missing = watchfd < 0;
+        }
+
+        uint64_t now = monotonic_ms();
+        if(now >= deadline)
+            return false;
+        uint64_t wait_ms = deadline - now;
+        if(dir_missing && wait_ms > REOPEN_MIN_MS)
+            wait_ms = REOPEN_MIN_MS;    // nothing to watch, look for directory again soon
+
+        struct pollfd pfd[2];
+        pfd[0].fd = wakefd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = watchfd >= 0 ? inotifyfd : -1;  // negative fd is ignored by poll
+        pfd[1].events = POLLIN;
+        int ret = poll(pfd, 2, (int)wait_ms);
+        if(ret < 0 && errno != EINTR)
+            return false;
+        if(ret > 0 && (pfd[0].revents & POLLIN))
+            return false;   // stop
+        if(ret <= 0 || !(pfd[1].revents & POLLIN))
+            continue;
+
+        // other nodes of the directory come and go, keep waiting for ours
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t len;
+        bool found = false;
+        while((len = read(inotifyfd, buf, sizeof(buf))) > 0) {
+            for(char *p = buf; p < buf + len; ) {
+                struct inotify_event *ev = (struct inotify_event*)p;
+                if(ev->mask & IN_IGNORED)
+                    watchfd = -1;   // directory removed, add again on next round
+                else if(ev->len > 0 && device_name == ev->name)
+                    found = true;
+                p += sizeof(struct inotify_event) + ev->len;
+            }
+        }
+        if(found)
+            return true;
+    }
+}
+
+/**
+ * reader thread main loop
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_SerialReader::run(void)
+{
+    HS_Backoff backoff(REOPEN_MIN_MS, REOPEN_MAX_MS);
+    while(running) {
+        if(fd < 0) {
+            int newfd = openPort();
+            if(newfd < 0) {
+                open_failures.fetch_add(1, std::memory_order_relaxed);
+                if(state.exchange(HS_SERIAL_WAITING) != HS_SERIAL_WAITING)
+                    HS_LOG_NOTICE("serial port %s not available, waiting", device.c_str());
+                if(waitForDevice((int)backoff.next()))
+                    backoff.reset();
+                continue;
+            }
+            pthread_mutex_lock(&port_mtx);
+            fd = newfd;
+            pthread_mutex_unlock(&port_mtx);
+            backoff.reset();
+            if(opened_once)
+                reconnects.fetch_add(1, std::memory_order_relaxed);
+            opened_once = true;
+            state = HS_SERIAL_CONNECTED;
+            HS_LOG_NOTICE("serial port %s opened", device.c_str());
+        }
+
+        struct pollfd pfd[2];
+        pfd[0].fd = wakefd;
+        pfd[0].events = POLLIN;
+        pfd[1].fd = fd;
+        pfd[1].events = POLLIN;
+        int ret = poll(pfd, 2, -1);
+        if(ret < 0 && errno != EINTR) {
+            HS_LOG_ERROR("serial poll failed(%s)", strerror(errno));
+            closePort();
+            continue;
+        }
+
+        if(ret > 0 && (pfd[1].revents & (POLLIN | POLLERR | POLLHUP))) {
+            // mark busy before stamping, see busySince
+            busy_since.store(0);
+            uint64_t timestamp = monotonic_ns();
+            busy_since.store(timestamp);
+            if(readChunk() < 0) {
+                busy_since.store(HS_SERIAL_IDLE);
+                HS_LOG_WARNING("serial read failed, try to open %s again", device.c_str());
+                closePort();
+                continue;
+            }
+            parseFrames(timestamp);
+            busy_since.store(HS_SERIAL_IDLE);
+        }
+    }
+    closePort();
+}
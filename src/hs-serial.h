@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOMESCREEN_SERIAL_H
+#define HOMESCREEN_SERIAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include <pthread.h>
+
+#define MESSAGE_HEADER_01  0xA5
+#define MESSAGE_HEADER_02  0x5A
+
+// header 01, header 02, data length
+#define MESSAGE_PREFIX_LENGTH  3
+// crc
+#define MESSAGE_SUFFIX_LENGTH  1
+
+#define MAX_RECEIVING_BUFFER   0xFF
+#define MESSAGE_MAX_DATA_LENGTH  (MAX_RECEIVING_BUFFER - MESSAGE_PREFIX_LENGTH - MESSAGE_SUFFIX_LENGTH)
+//CRC POLYNOMIAL parameter
+#define CRC_POLYNOMIAL  0x131
+// crc-8, msb first, no final xor, computed over data length and data bytes
+#define CRC_INIT        0xFF
+
+/*
+ * byte ring buffer, capacity must be power of two.
+ * single producer and single consumer, both are the serial reader thread.
+ */
+class HS_RingBuffer {
+public:
+    explicit HS_RingBuffer(size_t capacity);
+    ~HS_RingBuffer();
+    HS_RingBuffer(HS_RingBuffer const &) = delete;
+    HS_RingBuffer &operator=(HS_RingBuffer const &) = delete;
+
+    size_t size(void) const { return tail - head; }
+    size_t space(void) const { return cap - size(); }
+    unsigned char peek(size_t offset) const { return buf[(head + offset) & mask]; }
+
+    unsigned char* writePtr(size_t *len);
+    void commit(size_t len) { tail += len; }
+    void copyOut(size_t offset, unsigned char *dst, size_t len) const;
+    void consume(size_t len) { head += len; }
+    size_t find(unsigned char c, size_t offset) const;
+    void clear(void) { head = tail = 0; }
+
+private:
+    unsigned char *buf;
+    size_t cap;
+    size_t mask;
+    size_t head = 0;
+    size_t tail = 0;
+};
+
+enum HS_SerialState {
+    HS_SERIAL_STOPPED = 0,
+    HS_SERIAL_WAITING,      // device missing or open failed, waiting for hot-plug or retry
+    HS_SERIAL_CONNECTED
+};
+
+struct HS_SerialStats {
+    uint32_t state;             // HS_SerialState
+    uint64_t reconnects;        // successful opens after the first one
+    uint64_t open_failures;
+    uint64_t bytes;
+    uint64_t frames;            // frames with good crc
+    uint64_t bad_crc;           // frames dropped for crc mismatch
+    uint64_t resyncs;           // times parser lost frame alignment
+    uint64_t skipped;           // bytes discarded while resynchronising
+    uint32_t bytes_per_sec;
+    uint32_t frames_per_sec;
+    uint64_t queue_dropped;     // frames lost before merge, set by HS_SerialManager
+};
+
+#define HS_SERIAL_IDLE  UINT64_MAX   // busySince value while reader waits for data
+
+class HS_SerialReader {
+public:
+    // timestamp is CLOCK_MONOTONIC nanoseconds when the frame's last bytes were read
+    typedef void (*frame_handler)(void *arg, uint64_t timestamp, const unsigned char *frame, int length);
+
+    HS_SerialReader(const char *device, frame_handler handler, void *arg = nullptr);
+    ~HS_SerialReader();
+    HS_SerialReader(HS_SerialReader const &) = delete;
+    HS_SerialReader &operator=(HS_SerialReader const &) = delete;
+
+    int start(void);
+    void stop(void);
+    int write(const void *data, size_t len);
+    void getStats(HS_SerialStats *stats) const;
+    void updateRate(void);
+    const char* getDevice(void) const { return device.c_str(); }
+
+    /*
+     * lower bound of timestamp of any frame handler may still be called
+     * with, HS_SERIAL_IDLE while waiting for data, 0 while taking a stamp
+     */
+    uint64_t busySince(void) const { return busy_since.load(); }
+
+private:
+    static void* threadMain(void *arg);
+    void run(void);
+    int openPort(void);
+    void closePort(void);
+    int readChunk(void);
+    void parseFrames(uint64_t timestamp);
+    void resync(size_t from);
+    bool waitForDevice(int timeout_ms);
+
+private:
+    std::string device;
+    std::string device_dir;     // watched for hot-plug
+    std::string device_name;
+    frame_handler handler;
+    void *handler_arg;
+    HS_RingBuffer ring;
+    unsigned char frame[MAX_RECEIVING_BUFFER];
+
+    pthread_t tid;
+    bool started = false;
+    std::atomic<bool> running;
+    int fd = -1;
+    int wakefd = -1;
+    int inotifyfd = -1;
+    int watchfd = -1;
+    bool opened_once = false;
+    pthread_mutex_t port_mtx;   // protect fd against close while writing
+
+    std::atomic<int> state;
+    std::atomic<uint64_t> busy_since;
+    std::atomic<uint64_t> reconnects;
+    std::atomic<uint64_t> open_failures;
+    std::atomic<uint64_t> total_bytes;
+    std::atomic<uint64_t> total_frames;
+    std::atomic<uint64_t> bad_crc;
+    std::atomic<uint64_t> resyncs;
+    std::atomic<uint64_t> skipped;
+    std::atomic<uint32_t> bytes_per_sec;
+    std::atomic<uint32_t> frames_per_sec;
+    uint64_t last_bytes = 0;
+    uint64_t last_frames = 0;
+    uint64_t last_rate_ms = 0;  // rate is updated by caller of updateRate only
+};
+
+unsigned char hs_serial_crc8(const unsigned char *data, size_t len);
+
+#endif // HOMESCREEN_SERIAL_H
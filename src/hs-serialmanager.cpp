@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include "hs-serialmanager.h"
+#include "hs-log.h"
+
+#define MERGE_RECHECK_MS    1   // a reader is inside a chunk, look again shortly
+
+/**
+ * HS_SerialManager construction function
+ *
+ * #### Parameters
+ *  - ports : comma separated device list, liked "/dev/ttyUSB0,/dev/ttyUSB1",
+ *            nullptr : HS_SERIAL_PORTS environment variable or HS_SERIAL_DEFAULT_PORTS
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_SerialManager::HS_SerialManager(const char *ports)
+    : running(false), wake_pending(false)
+{
+    if(ports == nullptr)
+        ports = getenv(HS_SERIAL_PORTS_ENV);
+    if(ports == nullptr || *ports == '\0')
+        ports = HS_SERIAL_DEFAULT_PORTS;
+
+    std::string list(ports);
+    size_t pos = 0;
+    while(pos <= list.size()) {
+        size_t end = list.find(',', pos);
+        if(end == std::string::npos)
+            end = list.size();
+        std::string device = list.substr(pos, end - pos);
+        pos = end + 1;
+
+        size_t first = device.find_first_not_of(" \t");
+        if(first == std::string::npos)
+            continue;
+        device = device.substr(first, device.find_last_not_of(" \t") - first + 1);
+        if(this->ports.size() >= HS_SERIAL_MAX_PORTS) {
+            HS_LOG_WARNING("too many serial ports, %s is ignored", device.c_str());
+            continue;
+        }
+
+        Port *port = new Port();
+        port->manager = this;
+        port->source = (int)this->ports.size();
+        port->reader = new HS_SerialReader(device.c_str(), &HS_SerialManager::onFrame, port);
+        port->head = 0;
+        port->tail = 0;
+        port->dropped = 0;
+        this->ports.push_back(port);
+        HS_LOG_NOTICE("serial port %d : %s", port->source, device.c_str());
+    }
+}
+
+/**
+ * HS_SerialManager destruction function
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_SerialManager::~HS_SerialManager()
+{
+    stop();
+    for(auto port : ports) {
+        delete port->reader;
+        delete port;
+    }
+}
+
+/**
+ * start merge thread when needed and all readers
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * 0 : success
+ * -1 : fail
+ *
+ */
+int HS_SerialManager::start(void)
+{
+    if(started)
+        return 0;
+
+    if(ports.size() > 1) {
+        wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if(wakefd < 0) {
+            HS_LOG_ERROR("HS_SerialManager eventfd failed(%s)", strerror(errno));
+            return -1;
+        }
+        running = true;
+        if(pthread_create(&tid, NULL, &HS_SerialManager::threadMain, this) != 0) {
+            running = false;
+            close(wakefd);
+            wakefd = -1;
+            return -1;
+        }
+    }
+    started = true;
+
+    int ret = 0;
+    for(auto port : ports) {
+        if(port->reader->start() != 0)
+            ret = -1;
+    }
+    return ret;
+}
+
+/**
+ * stop all readers and merge thread
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_SerialManager::stop(void)
+{
+    if(!started)
+        return;
+
+    for(auto port : ports)
+        port->reader->stop();
+
+    if(wakefd >= 0) {
+        running = false;
+        wakeup();
+        pthread_join(tid, NULL);
+        close(wakefd);
+        wakefd = -1;
+    }
+    started = false;
+}
+
+/**
+ * get device path of port
+ *
+ * #### Parameters
+ *  - source : port index
+ *
+ * #### Return
+ * device path, nullptr : no such port
+ *
+ */
+const char* HS_SerialManager::getDevice(int source) const
+{
+    if(source < 0 || source >= (int)ports.size())
+        return nullptr;
+    return ports[source]->reader->getDevice();
+}
+
+/**
+ * write data to serial port
+ *
+ * #### Parameters
+ *  - source : port index
+ *  - data : data to write
+ *  - len : data length
+ *
+ * #### Return
+ * written length, -1 : fail
+ *
+ */
+int HS_SerialManager::write(int source, const void *data, size_t len)
+{
+    if(source < 0 || source >= (int)ports.size())
+        return -1;
+    return ports[source]->reader->write(data, len);
+}
+
+/**
+ * get port statistics
+ *
+ * #### Parameters
+ *  - source : port index
+ *  - stats : [OUT] statistics
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_SerialManager::getStats(int source, HS_SerialStats *stats) const
+{
+    if(source < 0 || source >= (int)ports.size()) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    ports[source]->reader->getStats(stats);
+    stats->queue_dropped = ports[source]->dropped.load(std::memory_order_relaxed);
+}
+
+/**
+ * update rates of all ports
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_SerialManager::updateRate(void)
+{
+    for(auto port : ports)
+        port->reader->updateRate();
+}
+
+/**
+ * frame handler, called in reader thread of the port
+ *
+ * #### Parameters
+ *  - arg : the port
+ *  - timestamp : arrival time
+ *  - frame : complete serial frame
+ *  - length : frame length
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_SerialManager::onFrame(void *arg, uint64_t timestamp, const unsigned char *frame, int length)
+{
+    Port *port = static_cast<Port*>(arg);
+    HS_TelemetryFrame decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    if(!HS_Telemetry::decode(frame, length, &decoded))
+        return;
+    decoded.timestamp = timestamp;
+    decoded.source = (uint8_t)port->source;
+
+    HS_SerialManager *manager = port->manager;
+    if(manager->ports.size() == 1) {
+        HS_Telemetry::instance()->publish(decoded);
+        return;
+    }
+
+    size_t tail = port->tail.load(std::memory_order_relaxed);
+    if(tail - port->head.load(std::memory_order_acquire) >= HS_SERIAL_QUEUE_SIZE) {
+        port->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    port->queue[tail & (HS_SERIAL_QUEUE_SIZE - 1)] = decoded;
+    port->tail.store(tail + 1, std::memory_order_release);
+    if(!manager->wake_pending.exchange(true))
+        manager->wakeup();
+}
+
+void HS_SerialManager::wakeup(void)
+{
+    uint64_t one = 1;
+    ssize_t ret = ::write(wakefd, &one, sizeof(one));
+    (void)ret;
+}
+
+void* HS_SerialManager::threadMain(void *arg)
+{
+    static_cast<HS_SerialManager*>(arg)->run();
+    return NULL;
+}
+
+/**
+ * publish queued frames in timestamp order.
+ * a frame is published only when no port can still produce an older one:
+ * a port with queued frames won't go below its queue head, an idle port
+ * stamps later frames after now, and a busy port won't go below the
+ * stamp of the chunk it is parsing.
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * true : frames are held until a busy port finishes its chunk
+ * false : all queues are empty
+ *
+ */
+bool HS_SerialManager::merge(void)
+{
+    for(;;) {
+        uint64_t now = HS_Telemetry::now();
+        uint64_t bound = UINT64_MAX;
+        uint64_t oldest = UINT64_MAX;
+        Port *next = nullptr;
+        for(auto port : ports) {
+            // load busy state before queue, a frame pushed in between is seen in queue
+            uint64_t busy = port->reader->busySince();
+            while(busy == 0) {
+                sched_yield();
+                busy = port->reader->busySince();
+            }
+
+            size_t head = port->head.load(std::memory_order_relaxed);
+            if(head != port->tail.load(std::memory_order_acquire)) {
+                uint64_t ts = port->queue[head & (HS_SERIAL_QUEUE_SIZE - 1)].timestamp;
+                if(ts < oldest) {
+                    oldest = ts;
+                    next = port;
+                }
+                if(ts < bound)
+                    bound = ts;
+            }
+            else {
+                uint64_t limit = (busy == HS_SERIAL_IDLE) ? now : busy;
+                if(limit < bound)
+                    bound = limit;
+            }
+        }
+
+        if(next == nullptr)
+            return false;
+        if(oldest > bound)
+            return true;
+
+        size_t head = next->head.load(std::memory_order_relaxed);
+        HS_TelemetryFrame frame = next->queue[head & (HS_SERIAL_QUEUE_SIZE - 1)];
+        next->head.store(head + 1, std::memory_order_release);
+        HS_Telemetry::instance()->publish(frame);
+    }
+}
+
+/**
+ * merge thread main loop
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_SerialManager::run(void)
+{
+    bool held = false;
+    while(running) {
+        struct pollfd pfd;
+        pfd.fd = wakefd;
+        pfd.events = POLLIN;
+        int ret = poll(&pfd, 1, held ? MERGE_RECHECK_MS : -1);
+        if(ret < 0 && errno != EINTR) {
+            HS_LOG_ERROR("serial merge poll failed(%s)", strerror(errno));
+            break;
+        }
+        if(ret > 0) {
+            uint64_t val;
+            ssize_t n = read(wakefd, &val, sizeof(val));
+            (void)n;
+            wake_pending.store(false);  // ordered before queue loads in merge
+        }
+        held = merge();
+    }
+}
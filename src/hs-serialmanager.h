@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOMESCREEN_SERIALMANAGER_H
+#define HOMESCREEN_SERIALMANAGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <vector>
+#include <pthread.h>
+#include "hs-serial.h"
+#include "hs-telemetry.h"
+
+#define HS_SERIAL_PORTS_ENV     "HS_SERIAL_PORTS"   // comma separated device list
+#define HS_SERIAL_DEFAULT_PORTS "/dev/ttyUSB0"
+#define HS_SERIAL_MAX_PORTS     8
+#define HS_SERIAL_QUEUE_SIZE    256                 // per port, power of two
+
+/*
+ * serial port set feeding HS_Telemetry.
+ * every port has its own reader thread which decodes frames and stamps
+ * them with source and arrival time. With one port frames are published
+ * directly from its reader thread. With more ports every reader puts
+ * frames into its own single producer single consumer queue, and a merge
+ * thread publishes them in timestamp order, so readers never share a lock.
+ */
+class HS_SerialManager {
+public:
+    HS_SerialManager(const char *ports = nullptr);
+    ~HS_SerialManager();
+    HS_SerialManager(HS_SerialManager const &) = delete;
+    HS_SerialManager &operator=(HS_SerialManager const &) = delete;
+
+    int start(void);
+    void stop(void);
+    int getPortCount(void) const { return (int)ports.size(); }
+    const char* getDevice(int source) const;
+    int write(int source, const void *data, size_t len);
+    void getStats(int source, HS_SerialStats *stats) const;
+    void updateRate(void);
+
+private:
+    struct Port {
+        HS_SerialManager *manager;
+        int source;
+        HS_SerialReader *reader;
+        HS_TelemetryFrame queue[HS_SERIAL_QUEUE_SIZE];
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+        std::atomic<uint64_t> dropped;
+    };
+
+    static void onFrame(void *arg, uint64_t timestamp, const unsigned char *frame, int length);
+    static void* threadMain(void *arg);
+    void run(void);
+    bool merge(void);
+    void wakeup(void);
+
+private:
+    std::vector<Port*> ports;
+    pthread_t tid;
+    bool started = false;
+    std::atomic<bool> running;
+    std::atomic<bool> wake_pending;
+    int wakefd = -1;
+};
+
+#endif // HOMESCREEN_SERIALMANAGER_H
@@ -0,0 +1,428 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+#include <algorithm>
+#include "hs-stats.h"
+#include "hs-telemetry.h"
+#include "hs-catalog.h"
+#include "hs-log.h"
+
+#ifdef HS_LOCK_STATS
+// registered instrumented mutexes, function local so that
+// mutexes with static storage may register during static init
+struct HS_LockList {
+    std::mutex mtx;
+    std::vector<HS_Mutex*> list;
+};
+
+static HS_LockList& lock_list(void)
+{
+    static HS_LockList *locks = new HS_LockList;
+    return *locks;
+}
+#endif
+
+/**
+ * record one duration
+ *
+ * #### Parameters
+ *  - ns : duration in nanoseconds
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Histogram::record(uint64_t ns)
+{
+    int bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+    if(bucket >= HS_HISTOGRAM_BUCKETS)
+        bucket = HS_HISTOGRAM_BUCKETS - 1;
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum_ns.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t max = max_ns.load(std::memory_order_relaxed);
+    while(ns > max && !max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+        ;
+}
+
+/**
+ * estimate percentile, upper bound of the bucket it falls in
+ *
+ * #### Parameters
+ *  - p : percentile, 0.0 - 1.0
+ *
+ * #### Return
+ * duration in nanoseconds
+ *
+ */
+uint64_t HS_Histogram::percentile(double p) const
+{
+    uint64_t total = count.load(std::memory_order_relaxed);
+    if(total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(p * total);
+    uint64_t seen = 0;
+    for(int i = 0; i < HS_HISTOGRAM_BUCKETS; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if(seen > rank)
+            return i ? std::min(((uint64_t)1 << i) - 1, max_ns.load(std::memory_order_relaxed)) : 0;
+    }
+    return max_ns.load(std::memory_order_relaxed);
+}
+
+/**
+ * add histogram summary to json object
+ *
+ * #### Parameters
+ *  - j_obj : the json object will join in summary
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Histogram::toJson(struct json_object *j_obj) const
+{
+    uint64_t total = count.load(std::memory_order_relaxed);
+    uint64_t avg = total ? sum_ns.load(std::memory_order_relaxed) / total : 0;
+    json_object_object_add(j_obj, "count", json_object_new_int64((int64_t)total));
+    json_object_object_add(j_obj, "avg_ns", json_object_new_int64((int64_t)avg));
+    json_object_object_add(j_obj, "p50_ns", json_object_new_int64((int64_t)percentile(0.5)));
+    json_object_object_add(j_obj, "p99_ns", json_object_new_int64((int64_t)percentile(0.99)));
+    json_object_object_add(j_obj, "max_ns", json_object_new_int64((int64_t)max_ns.load(std::memory_order_relaxed)));
+}
+
+/**
+ * HS_Mutex construction function
+ *
+ * #### Parameters
+ *  - name : lock name in statistics, string literal
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_Mutex::HS_Mutex(const char *name)
+#ifdef HS_LOCK_STATS
+    : name(name)
+{
+    HS_LockList &locks = lock_list();
+    std::lock_guard<std::mutex> lock(locks.mtx);
+    locks.list.push_back(this);
+}
+#else
+{
+    (void)name;
+}
+#endif
+
+/**
+ * HS_Mutex destruction function
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+HS_Mutex::~HS_Mutex()
+{
+#ifdef HS_LOCK_STATS
+    HS_LockList &locks = lock_list();
+    std::lock_guard<std::mutex> lock(locks.mtx);
+    locks.list.erase(std::remove(locks.list.begin(), locks.list.end(), this), locks.list.end());
+#endif
+}
+
+#ifdef HS_LOCK_STATS
+/**
+ * lock, uncontended path costs one try_lock and one clock read
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Mutex::lock(void)
+{
+    if(!mtx.try_lock()) {
+        uint64_t start = HS_Telemetry::now();
+        mtx.lock();
+        hold_start = HS_Telemetry::now();
+        contended.fetch_add(1, std::memory_order_relaxed);
+        wait.record(hold_start - start);
+        return;
+    }
+    hold_start = HS_Telemetry::now();
+    wait.record(0);
+}
+
+/**
+ * unlock
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Mutex::unlock(void)
+{
+    uint64_t held = HS_Telemetry::now() - hold_start;
+    mtx.unlock();
+    hold.record(held);
+}
+
+/**
+ * add lock statistics to json object
+ *
+ * #### Parameters
+ *  - j_obj : the json object will join in statistics
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Mutex::toJson(struct json_object *j_obj) const
+{
+    struct json_object *j_wait = json_object_new_object();
+    struct json_object *j_hold = json_object_new_object();
+    wait.toJson(j_wait);
+    hold.toJson(j_hold);
+    json_object_object_add(j_obj, "name", json_object_new_string(name));
+    json_object_object_add(j_obj, "acquisitions", json_object_new_int64((int64_t)wait.getCount()));
+    json_object_object_add(j_obj, "contended", json_object_new_int64((int64_t)contended.load(std::memory_order_relaxed)));
+    json_object_object_add(j_obj, "wait", j_wait);
+    json_object_object_add(j_obj, "hold", j_hold);
+}
+#endif
+
+/**
+ * get statistics of all instrumented mutexes
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * json array of lock statistics, empty when HS_LOCK_STATS is off
+ *
+ */
+struct json_object* hs_lock_stats_to_json(void)
+{
+    struct json_object *j_locks = json_object_new_array();
+#ifdef HS_LOCK_STATS
+    HS_LockList &locks = lock_list();
+    std::lock_guard<std::mutex> lock(locks.mtx);
+    for(auto mtx : locks.list) {
+        struct json_object *j_lock = json_object_new_object();
+        mtx->toJson(j_lock);
+        json_object_array_add(j_locks, j_lock);
+    }
+#endif
+    return j_locks;
+}
+
+#ifdef HS_VERB_STATS
+// latency histograms of all verbs, written by threads mapped to the shard
+struct HS_VerbShard {
+    std::atomic<uint64_t> count[HS_CATALOG_MAX][HS_LATENCY_BUCKETS];
+    std::atomic<uint64_t> sum_ns[HS_CATALOG_MAX];
+    std::atomic<uint64_t> max_ns[HS_CATALOG_MAX];
+};
+
+// merged histogram of one verb
+struct HS_VerbSummary {
+    uint64_t count[HS_LATENCY_BUCKETS];
+    uint64_t total;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+};
+
+// shards are allocated on first use and never freed
+static std::atomic<HS_VerbShard*> verb_shards[HS_LATENCY_SHARDS];
+static std::atomic<unsigned int> verb_next_shard {0};
+static thread_local HS_VerbShard *verb_shard = nullptr;
+
+static int latency_bucket(uint64_t ns)
+{
+    if(ns < (1u << HS_LATENCY_SUB_BITS))
+        return (int)ns;
+
+    int exp = 63 - __builtin_clzll(ns);
+    if(exp >= HS_LATENCY_MAX_BITS)
+        return HS_LATENCY_BUCKETS - 1;
+    int sub = (int)(ns >> (exp - HS_LATENCY_SUB_BITS)) & ((1 << HS_LATENCY_SUB_BITS) - 1);
+    return ((exp - HS_LATENCY_SUB_BITS + 1) << HS_LATENCY_SUB_BITS) + sub;
+}
+
+static uint64_t latency_bucket_upper(int bucket)
+{
+    if(bucket < (1 << HS_LATENCY_SUB_BITS))
+        return (uint64_t)bucket;
+
+    int exp = (bucket >> HS_LATENCY_SUB_BITS) + HS_LATENCY_SUB_BITS - 1;
+    uint64_t sub = bucket & ((1 << HS_LATENCY_SUB_BITS) - 1);
+    uint64_t lower = (((uint64_t)1 << HS_LATENCY_SUB_BITS) + sub) << (exp - HS_LATENCY_SUB_BITS);
+    return lower + ((uint64_t)1 << (exp - HS_LATENCY_SUB_BITS)) - 1;
+}
+
+static HS_VerbShard* my_verb_shard(void)
+{
+    if(verb_shard != nullptr)
+        return verb_shard;
+
+    unsigned int index = verb_next_shard.fetch_add(1, std::memory_order_relaxed) % HS_LATENCY_SHARDS;
+    HS_VerbShard *shard = verb_shards[index].load(std::memory_order_acquire);
+    if(shard == nullptr) {
+        HS_VerbShard *created = new HS_VerbShard();
+        if(verb_shards[index].compare_exchange_strong(shard, created, std::memory_order_acq_rel))
+            shard = created;
+        else
+            delete created;     // another thread installed it, shard is updated
+    }
+    verb_shard = shard;
+    return shard;
+}
+
+static void merge_verb(int verb_id, HS_VerbSummary *summary)
+{
+    *summary = HS_VerbSummary();
+    for(int i = 0; i < HS_LATENCY_SHARDS; ++i) {
+        HS_VerbShard *shard = verb_shards[i].load(std::memory_order_acquire);
+        if(shard == nullptr)
+            continue;
+        for(int b = 0; b < HS_LATENCY_BUCKETS; ++b) {
+            uint64_t n = shard->count[verb_id][b].load(std::memory_order_relaxed);
+            summary->count[b] += n;
+            summary->total += n;
+        }
+        summary->sum_ns += shard->sum_ns[verb_id].load(std::memory_order_relaxed);
+        summary->max_ns = std::max(summary->max_ns, shard->max_ns[verb_id].load(std::memory_order_relaxed));
+    }
+}
+
+static uint64_t summary_percentile(const HS_VerbSummary &summary, double p)
+{
+    uint64_t rank = (uint64_t)(p * summary.total);
+    uint64_t seen = 0;
+    for(int b = 0; b < HS_LATENCY_BUCKETS; ++b) {
+        seen += summary.count[b];
+        if(seen > rank && b < HS_LATENCY_BUCKETS - 1)
+            return std::min(latency_bucket_upper(b), summary.max_ns);
+        if(seen > rank)
+            break;  // last bucket is open ended
+    }
+    return summary.max_ns;
+}
+#endif
+
+/**
+ * record latency of one verb call, lock free
+ *
+ * #### Parameters
+ *  - verb_id : the verb, HS_VerbId
+ *  - ns : duration in nanoseconds
+ *
+ * #### Return
+ * None
+ *
+ */
+void hs_verb_stats_record(int verb_id, uint64_t ns)
+{
+#ifdef HS_VERB_STATS
+    if(verb_id < 0 || verb_id >= HS_CATALOG_MAX)
+        return;
+
+    HS_VerbShard *shard = my_verb_shard();
+    shard->count[verb_id][latency_bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    shard->sum_ns[verb_id].fetch_add(ns, std::memory_order_relaxed);
+    uint64_t max = shard->max_ns[verb_id].load(std::memory_order_relaxed);
+    while(ns > max && !shard->max_ns[verb_id].compare_exchange_weak(max, ns, std::memory_order_relaxed))
+        ;
+#else
+    (void)verb_id;
+    (void)ns;
+#endif
+}
+
+/**
+ * get latency statistics of called verbs
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * json array of verb statistics, empty when HS_VERB_STATS is off
+ *
+ */
+struct json_object* hs_verb_stats_to_json(void)
+{
+    struct json_object *j_verbs = json_object_new_array();
+#ifdef HS_VERB_STATS
+    HS_VerbSummary summary;
+    for(int id = 0; id < HS_CATALOG_MAX; ++id) {
+        merge_verb(id, &summary);
+        if(summary.total == 0)
+            continue;
+
+        struct json_object *j_verb = json_object_new_object();
+        json_object_object_add(j_verb, "verb", json_object_new_string(hs_catalog_name(id)));
+        json_object_object_add(j_verb, "count", json_object_new_int64((int64_t)summary.total));
+        json_object_object_add(j_verb, "avg_ns", json_object_new_int64((int64_t)(summary.sum_ns / summary.total)));
+        json_object_object_add(j_verb, "p50_ns", json_object_new_int64((int64_t)summary_percentile(summary, 0.5)));
+        json_object_object_add(j_verb, "p99_ns", json_object_new_int64((int64_t)summary_percentile(summary, 0.99)));
+        json_object_object_add(j_verb, "p999_ns", json_object_new_int64((int64_t)summary_percentile(summary, 0.999)));
+        json_object_object_add(j_verb, "max_ns", json_object_new_int64((int64_t)summary.max_ns));
+        json_object_array_add(j_verbs, j_verb);
+    }
+#endif
+    return j_verbs;
+}
+
+/**
+ * write latency statistics of called verbs to log, used at exit
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * None
+ *
+ */
+void hs_verb_stats_dump(void)
+{
+#ifdef HS_VERB_STATS
+    HS_VerbSummary summary;
+    for(int id = 0; id < HS_CATALOG_MAX; ++id) {
+        merge_verb(id, &summary);
+        if(summary.total == 0)
+            continue;
+        HS_LOG_NOTICE("verb %s: count=%llu avg=%lluns p50=%lluns p99=%lluns p999=%lluns max=%lluns",
+                      hs_catalog_name(id), (unsigned long long)summary.total,
+                      (unsigned long long)(summary.sum_ns / summary.total),
+                      (unsigned long long)summary_percentile(summary, 0.5),
+                      (unsigned long long)summary_percentile(summary, 0.99),
+                      (unsigned long long)summary_percentile(summary, 0.999),
+                      (unsigned long long)summary.max_ns);
+    }
+#endif
+}
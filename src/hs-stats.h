@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOMESCREEN_STATS_H
+#define HOMESCREEN_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <json-c/json.h>
+
+#define HS_HISTOGRAM_BUCKETS    40      // bucket i : [2^(i-1), 2^i) nanoseconds
+
+#define HS_LATENCY_SUB_BITS     3       // 8 linear sub buckets per power of 2, 12.5% error
+#define HS_LATENCY_MAX_BITS     40      // longer durations land in last bucket
+#define HS_LATENCY_BUCKETS      ((HS_LATENCY_MAX_BITS - HS_LATENCY_SUB_BITS + 1) << HS_LATENCY_SUB_BITS)
+#define HS_LATENCY_SHARDS       16      // threads beyond share shards
+
+/*
+ * lock-free log2 histogram of durations in nanoseconds
+ */
+class HS_Histogram {
+public:
+    HS_Histogram() = default;
+    HS_Histogram(HS_Histogram const &) = delete;
+    HS_Histogram &operator=(HS_Histogram const &) = delete;
+
+    void record(uint64_t ns);
+    uint64_t getCount(void) const { return count.load(std::memory_order_relaxed); }
+    uint64_t percentile(double p) const;
+    void toJson(struct json_object *j_obj) const;
+
+private:
+    std::atomic<uint64_t> buckets[HS_HISTOGRAM_BUCKETS] = {};
+    std::atomic<uint64_t> count {0};
+    std::atomic<uint64_t> sum_ns {0};
+    std::atomic<uint64_t> max_ns {0};
+};
+
+/*
+ * std::mutex with wait and hold time histograms and contention count,
+ * usable with std::lock_guard. Without HS_LOCK_STATS it is a plain mutex.
+ * every instrumented mutex registers itself by name for hs_lock_stats_to_json.
+ */
+class HS_Mutex {
+public:
+    explicit HS_Mutex(const char *name);
+    ~HS_Mutex();
+    HS_Mutex(HS_Mutex const &) = delete;
+    HS_Mutex &operator=(HS_Mutex const &) = delete;
+
+#ifdef HS_LOCK_STATS
+    void lock(void);
+    void unlock(void);
+    void toJson(struct json_object *j_obj) const;
+#else
+    void lock(void) { mtx.lock(); }
+    void unlock(void) { mtx.unlock(); }
+#endif
+
+private:
+    std::mutex mtx;
+#ifdef HS_LOCK_STATS
+    const char *name;
+    uint64_t hold_start = 0;    // written by owner only
+    std::atomic<uint64_t> contended {0};
+    HS_Histogram wait;
+    HS_Histogram hold;
+#endif
+};
+
+struct json_object* hs_lock_stats_to_json(void);
+
+/*
+ * per verb latency, log-linear histograms in per-thread shards which
+ * are merged on read. recorded only when built with HS_VERB_STATS.
+ */
+void hs_verb_stats_record(int verb_id, uint64_t ns);
+struct json_object* hs_verb_stats_to_json(void);
+void hs_verb_stats_dump(void);
+
+#endif // HOMESCREEN_STATS_H
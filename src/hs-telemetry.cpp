@@ -0,0 +1,516 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <time.h>
+#include <cstdlib>
+#include <cstring>
+#include "hs-telemetry.h"
+#include "hs-serial.h"
+#include "hs-log.h"
+
+// data offset in serial frame, after header 01, header 02, data length
+enum {
+    FIELD_ODO = MESSAGE_PREFIX_LENGTH,
+    FIELD_CUR_SPEED,
+    FIELD_BATTERY_LEV,
+    FIELD_SIGNAL_LIGHT_LEFT,
+    FIELD_SIGNAL_LIGHT_RIGHT,
+    FIELD_END
+};
+
+/**
+ * get instance
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * HS_Telemetry instance pointer
+ *
+ */
+HS_Telemetry* HS_Telemetry::instance(void)
+{
+    static HS_Telemetry *me = new HS_Telemetry();
+    return me;
+}
+
+/**
+ * get monotonic time stamp
+ *
+ * #### Parameters
+ *  - Nothing
+ *
+ * #### Return
+ * CLOCK_MONOTONIC in nanoseconds
+ *
+ */
+uint64_t HS_Telemetry::now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * add frame listener
+ *
+ * #### Parameters
+ *  - f : listener function
+ *
+ * #### Return
+ * 0 : success
+ * -1 : listener table is full
+ *
+ */
+int HS_Telemetry::addListener(listener_func f)
+{
+    int count = listener_count.load();
+    if(f == nullptr || count >= HS_TELEMETRY_MAX_LISTENER) {
+        HS_LOG_ERROR("can't add telemetry listener");
+        return -1;
+    }
+    listeners[count] = f;
+    listener_count.store(count + 1);
+    return 0;
+}
+
+/**
+ * decode data fields of serial frame
+ *
+ * #### Parameters
+ *  - msg : complete serial frame
+ *  - length : frame length, prefix and crc included
+ *  - frame : [OUT] decoded fields, seq, timestamp and source are untouched
+ *
+ * #### Return
+ * true : success
+ * false : frame too short
+ *
+ */
+bool HS_Telemetry::decode(const unsigned char *msg, int length, HS_TelemetryFrame *frame)
+{
+    // data length byte must cover the fields, crc byte is not data
+    if(length < FIELD_END + MESSAGE_SUFFIX_LENGTH || msg[2] < FIELD_END - MESSAGE_PREFIX_LENGTH) {
+        HS_LOG_WARNING("telemetry frame too short, length=%d", length);
+        return false;
+    }
+
+    frame->odo = msg[FIELD_ODO];
+    frame->curSpeed = msg[FIELD_CUR_SPEED];
+    frame->batteryLev = msg[FIELD_BATTERY_LEV];
+    frame->signalLightLeft = msg[FIELD_SIGNAL_LIGHT_LEFT];
+    frame->signalLightRight = msg[FIELD_SIGNAL_LIGHT_RIGHT];
+    return true;
+}
+
+/**
+ * number frame and publish it to listeners, single publishing thread
+ *
+ * #### Parameters
+ *  - frame : decoded frame, seq is assigned here
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Telemetry::publish(const HS_TelemetryFrame &frame)
+{
+    HS_TelemetryFrame numbered = frame;
+    numbered.seq = seq++;
+    storeLatest(numbered);
+    int count = listener_count.load();
+    for(int i = 0; i < count; ++i)
+        listeners[i](numbered);
+}
+
+/**
+ * get latest published frame without locking
+ *
+ * #### Parameters
+ *  - frame : [OUT] latest frame
+ *
+ * #### Return
+ * true : success
+ * false : no frame published yet
+ *
+ */
+bool HS_Telemetry::getLatest(HS_TelemetryFrame *frame) const
+{
+    uint64_t words[SNAPSHOT_WORDS];
+    uint64_t begin, end;
+    do {
+        begin = snapshot_seq.load(std::memory_order_acquire);
+        for(int i = 0; i < SNAPSHOT_WORDS; ++i)
+            words[i] = snapshot[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        end = snapshot_seq.load(std::memory_order_relaxed);
+    } while(begin != end || (begin & 1));
+
+    if(begin == 0)
+        return false;
+    memcpy(frame, words, sizeof(*frame));
+    return true;
+}
+
+/**
+ * update latest frame snapshot, single writer
+ *
+ * #### Parameters
+ *  - frame : decoded frame
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_Telemetry::storeLatest(const HS_TelemetryFrame &frame)
+{
+    uint64_t words[SNAPSHOT_WORDS] = {};
+    memcpy(words, &frame, sizeof(frame));
+
+    uint64_t begin = snapshot_seq.load(std::memory_order_relaxed);
+    snapshot_seq.store(begin + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for(int i = 0; i < SNAPSHOT_WORDS; ++i)
+        snapshot[i].store(words[i], std::memory_order_relaxed);
+    snapshot_seq.store(begin + 2, std::memory_order_release);
+}
+
+/**
+ * get changed fields between two frames
+ *
+ * #### Parameters
+ *  - a : frame
+ *  - b : frame
+ *
+ * #### Return
+ * mask of HS_TELEMETRY_FIELD_*
+ *
+ */
+unsigned int hs_telemetry_changed(const HS_TelemetryFrame &a, const HS_TelemetryFrame &b)
+{
+    unsigned int mask = 0;
+    if(a.odo != b.odo)
+        mask |= HS_TELEMETRY_FIELD_ODO;
+    if(a.curSpeed != b.curSpeed)
+        mask |= HS_TELEMETRY_FIELD_CUR_SPEED;
+    if(a.batteryLev != b.batteryLev)
+        mask |= HS_TELEMETRY_FIELD_BATTERY_LEV;
+    if(a.signalLightLeft != b.signalLightLeft)
+        mask |= HS_TELEMETRY_FIELD_SIGNAL_LIGHT_LEFT;
+    if(a.signalLightRight != b.signalLightRight)
+        mask |= HS_TELEMETRY_FIELD_SIGNAL_LIGHT_RIGHT;
+    return mask;
+}
+
+static const char *field_names[HS_TELEMETRY_FIELD_COUNT] = {
+    "odo", "curSpeed", "batteryLev", "signalLightLeft", "signalLightRight"
+};
+
+/**
+ * get field name, bit index of HS_TELEMETRY_FIELD_*
+ *
+ * #### Parameters
+ *  - index : field index
+ *
+ * #### Return
+ * field name liked "curSpeed", nullptr : no such field
+ *
+ */
+const char* hs_telemetry_field_name(int index)
+{
+    if(index < 0 || index >= HS_TELEMETRY_FIELD_COUNT)
+        return nullptr;
+    return field_names[index];
+}
+
+/**
+ * get field value, bit index of HS_TELEMETRY_FIELD_*
+ *
+ * #### Parameters
+ *  - frame : decoded frame
+ *  - index : field index
+ *
+ * #### Return
+ * field value
+ *
+ */
+int hs_telemetry_field_value(const HS_TelemetryFrame &frame, int index)
+{
+    switch(index) {
+    case 0: return frame.odo;
+    case 1: return frame.curSpeed;
+    case 2: return frame.batteryLev;
+    case 3: return frame.signalLightLeft;
+    case 4: return frame.signalLightRight;
+    default: return 0;
+    }
+}
+
+/**
+ * set receiver option
+ *  - delta=1|0 : send only changed fields
+ *  - keyframe=N : frames between keyframes in delta mode
+ *  - rate=N : at most N frames per second, 0 : every frame
+ *  - <field>=N : deliver only when field changed by N at least, liked batteryLev=5
+ *
+ * #### Parameters
+ *  - key : option name
+ *  - value : option value
+ *
+ * #### Return
+ * true : option is known
+ * false : unknown option
+ *
+ */
+bool HS_TelemetryFilter::setOption(const char *key, const char *value)
+{
+    if(strcmp(key, "delta") == 0) {
+        enabled = (atoi(value) != 0);
+    }
+    else if(strcmp(key, "keyframe") == 0) {
+        if(atoi(value) > 0)
+            keyframe_interval = atoi(value);
+    }
+    else if(strcmp(key, "rate") == 0) {
+        double rate = atof(value);
+        min_interval_ns = rate > 0 ? (uint64_t)(1000000000.0 / rate) : 0;
+    }
+    else {
+        int i = 0;
+        while(i < HS_TELEMETRY_FIELD_COUNT && strcmp(key, field_names[i]) != 0)
+            ++i;
+        if(i == HS_TELEMETRY_FIELD_COUNT)
+            return false;
+        threshold[i] = abs(atoi(value));
+        if(threshold[i] > 0)
+            watched |= 1u << i;
+        else
+            watched &= ~(1u << i);
+    }
+    reset();
+    return true;
+}
+
+/**
+ * decide what to send of frame
+ *
+ * #### Parameters
+ *  - frame : next frame
+ *
+ * #### Return
+ * mask of HS_TELEMETRY_FIELD_* and HS_TELEMETRY_KEYFRAME, 0 : nothing to send
+ *
+ */
+unsigned int HS_TelemetryFilter::mask(const HS_TelemetryFrame &frame) const
+{
+    if(!have_last)
+        return HS_TELEMETRY_FIELD_ALL | HS_TELEMETRY_KEYFRAME;
+    if(min_interval_ns != 0 && frame.timestamp - last.timestamp < min_interval_ns)
+        return 0;
+
+    unsigned int changed;
+    if(watched == 0) {
+        if(!enabled)
+            return HS_TELEMETRY_FIELD_ALL | HS_TELEMETRY_KEYFRAME;
+        changed = hs_telemetry_changed(last, frame);
+    }
+    else {
+        changed = 0;
+        for(int i = 0; i < HS_TELEMETRY_FIELD_COUNT; ++i) {
+            if((watched & (1u << i))
+               && abs(hs_telemetry_field_value(frame, i) - hs_telemetry_field_value(last, i)) >= threshold[i])
+                changed |= 1u << i;
+        }
+        if(changed == 0)
+            return 0;
+        if(!enabled)
+            return HS_TELEMETRY_FIELD_ALL | HS_TELEMETRY_KEYFRAME;
+    }
+
+    if(since_keyframe + 1 >= keyframe_interval)
+        return HS_TELEMETRY_FIELD_ALL | HS_TELEMETRY_KEYFRAME;
+    return changed;
+}
+
+/**
+ * record frame as sent to receiver, only sent fields are remembered so
+ * changes below threshold add up
+ *
+ * #### Parameters
+ *  - frame : sent frame
+ *  - mask : what was sent, result of mask()
+ *
+ * #### Return
+ * None
+ *
+ */
+void HS_TelemetryFilter::sent(const HS_TelemetryFrame &frame, unsigned int mask)
+{
+    if(mask & HS_TELEMETRY_KEYFRAME) {
+        since_keyframe = 0;
+        last = frame;
+    }
+    else {
+        ++since_keyframe;
+        if(mask & HS_TELEMETRY_FIELD_ODO)
+            last.odo = frame.odo;
+        if(mask & HS_TELEMETRY_FIELD_CUR_SPEED)
+            last.curSpeed = frame.curSpeed;
+        if(mask & HS_TELEMETRY_FIELD_BATTERY_LEV)
+            last.batteryLev = frame.batteryLev;
+        if(mask & HS_TELEMETRY_FIELD_SIGNAL_LIGHT_LEFT)
+            last.signalLightLeft = frame.signalLightLeft;
+        if(mask & HS_TELEMETRY_FIELD_SIGNAL_LIGHT_RIGHT)
+            last.signalLightRight = frame.signalLightRight;
+        last.seq = frame.seq;
+        last.timestamp = frame.timestamp;
+    }
+    have_last = true;
+}
+
+static void put_le(unsigned char *p, uint64_t value, int size)
+{
+    for(int i = 0; i < size; ++i)
+        p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static uint64_t get_le(const unsigned char *p, int size)
+{
+    uint64_t value = 0;
+    for(int i = 0; i < size; ++i)
+        value |= (uint64_t)p[i] << (8 * i);
+    return value;
+}
+
+/**
+ * encode frame as binary record
+ *
+ * #### Parameters
+ *  - frame : decoded frame
+ *  - buf : [OUT] at least HS_TELEMETRY_RECORD_SIZE bytes
+ *
+ * #### Return
+ * record length
+ *
+ */
+size_t hs_telemetry_encode(const HS_TelemetryFrame &frame, unsigned char *buf)
+{
+    put_le(buf, HS_TELEMETRY_RECORD_SIZE, 2);
+    buf[2] = HS_TELEMETRY_RECORD_VERSION;
+    buf[3] = HS_TELEMETRY_RECORD_FRAME;
+    put_le(buf + 4, frame.seq, 4);
+    put_le(buf + 8, frame.timestamp, 8);
+    buf[16] = frame.odo;
+    buf[17] = frame.curSpeed;
+    buf[18] = frame.batteryLev;
+    buf[19] = frame.signalLightLeft;
+    buf[20] = frame.signalLightRight;
+    buf[21] = frame.source;
+    buf[22] = buf[23] = 0;
+    return HS_TELEMETRY_RECORD_SIZE;
+}
+
+/**
+ * encode changed fields of frame as binary delta record,
+ * a keyframe mask is encoded as full record
+ *
+ * #### Parameters
+ *  - frame : decoded frame
+ *  - mask : fields to encode
+ *  - buf : [OUT] at least HS_TELEMETRY_RECORD_SIZE bytes
+ *
+ * #### Return
+ * record length
+ *
+ */
+size_t hs_telemetry_encode_delta(const HS_TelemetryFrame &frame, unsigned int mask, unsigned char *buf)
+{
+    if(mask & HS_TELEMETRY_KEYFRAME)
+        return hs_telemetry_encode(frame, buf);
+
+    const uint8_t fields[] = {
+        frame.odo, frame.curSpeed, frame.batteryLev, frame.signalLightLeft, frame.signalLightRight
+    };
+    size_t len = HS_TELEMETRY_DELTA_SIZE;
+    for(int i = 0; i < (int)sizeof(fields); ++i) {
+        if(mask & (1u << i))
+            buf[len++] = fields[i];
+    }
+    put_le(buf, len, 2);
+    buf[2] = HS_TELEMETRY_RECORD_VERSION;
+    buf[3] = HS_TELEMETRY_RECORD_DELTA;
+    put_le(buf + 4, frame.seq, 4);
+    put_le(buf + 8, frame.timestamp, 8);
+    buf[16] = (unsigned char)(mask & HS_TELEMETRY_FIELD_ALL);
+    buf[17] = frame.source;
+    return len;
+}
+
+/**
+ * decode binary record
+ *
+ * #### Parameters
+ *  - buf : received bytes, starting at a record
+ *  - len : received length
+ *  - frame : [IN/OUT] decoded frame, a delta record updates only
+ *            changed fields so pass the previous frame of the stream
+ *
+ * #### Return
+ * > 0 : consumed record length
+ * 0 : need more bytes
+ * -1 : unknown version or broken record
+ *
+ */
+int hs_telemetry_decode(const unsigned char *buf, size_t len, HS_TelemetryFrame *frame)
+{
+    if(len < 4)
+        return 0;
+
+    size_t size = get_le(buf, 2);
+    if(buf[2] != HS_TELEMETRY_RECORD_VERSION || size < HS_TELEMETRY_DELTA_SIZE
+    || (buf[3] == HS_TELEMETRY_RECORD_FRAME && size < HS_TELEMETRY_RECORD_SIZE))
+        return -1;
+    if(len < size)
+        return 0;
+
+    if(buf[3] == HS_TELEMETRY_RECORD_DELTA) {
+        uint8_t *fields[] = {
+            &frame->odo, &frame->curSpeed, &frame->batteryLev, &frame->signalLightLeft, &frame->signalLightRight
+        };
+        size_t pos = HS_TELEMETRY_DELTA_SIZE;
+        for(int i = 0; i < 5; ++i) {
+            if(!(buf[16] & (1u << i)))
+                continue;
+            if(pos >= size)
+                return -1;
+            *fields[i] = buf[pos++];
+        }
+        frame->seq = (uint32_t)get_le(buf + 4, 4);
+        frame->timestamp = get_le(buf + 8, 8);
+        frame->source = buf[17];
+    }
+    else if(buf[3] == HS_TELEMETRY_RECORD_FRAME) {
+        frame->seq = (uint32_t)get_le(buf + 4, 4);
+        frame->timestamp = get_le(buf + 8, 8);
+        frame->odo = buf[16];
+        frame->curSpeed = buf[17];
+        frame->batteryLev = buf[18];
+        frame->signalLightLeft = buf[19];
+        frame->signalLightRight = buf[20];
+        frame->source = buf[21];
+    }
+    return (int)size;
+}
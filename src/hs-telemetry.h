@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HOMESCREEN_TELEMETRY_H
+#define HOMESCREEN_TELEMETRY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+
+#define HS_TELEMETRY_MAX_LISTENER  8
+
+/*
+ * binary telemetry record, all fields little-endian
+ *
+ *  offset size
+ *   0     2    record length in bytes, including this field
+ *   2     1    version, HS_TELEMETRY_RECORD_VERSION
+ *   3     1    record type, HS_TELEMETRY_RECORD_FRAME
+ *   4     4    sequence number
+ *   8     8    CLOCK_MONOTONIC time stamp in nanoseconds
+ *  16     1    odo
+ *  17     1    curSpeed
+ *  18     1    batteryLev
+ *  19     1    signalLightLeft
+ *  20     1    signalLightRight
+ *  21     1    source, index of serial port in HS_SERIAL_PORTS
+ *  22     2    reserved, zero
+ *
+ * delta record, only fields set in mask follow in the order above
+ *
+ *  offset size
+ *   0     2    record length in bytes, HS_TELEMETRY_DELTA_SIZE + changed fields
+ *   2     1    version, HS_TELEMETRY_RECORD_VERSION
+ *   3     1    record type, HS_TELEMETRY_RECORD_DELTA
+ *   4     4    sequence number
+ *   8     8    CLOCK_MONOTONIC time stamp in nanoseconds
+ *  16     1    changed field mask, HS_TELEMETRY_FIELD_*
+ *  17     1    source
+ *  18     n    changed fields
+ */
+#define HS_TELEMETRY_RECORD_VERSION   1
+#define HS_TELEMETRY_RECORD_FRAME     1
+#define HS_TELEMETRY_RECORD_DELTA     2
+#define HS_TELEMETRY_RECORD_SIZE      24
+#define HS_TELEMETRY_DELTA_SIZE       18
+
+#define HS_TELEMETRY_FIELD_ODO                  0x01
+#define HS_TELEMETRY_FIELD_CUR_SPEED            0x02
+#define HS_TELEMETRY_FIELD_BATTERY_LEV          0x04
+#define HS_TELEMETRY_FIELD_SIGNAL_LIGHT_LEFT    0x08
+#define HS_TELEMETRY_FIELD_SIGNAL_LIGHT_RIGHT   0x10
+#define HS_TELEMETRY_FIELD_ALL                  0x1F
+#define HS_TELEMETRY_FIELD_COUNT                5
+#define HS_TELEMETRY_KEYFRAME                   0x20    // full frame, resync point for delta receivers
+#define HS_TELEMETRY_MASK_COUNT                 0x40
+#define HS_TELEMETRY_KEYFRAME_INTERVAL          50      // frames between keyframes in delta mode
+
+// decoded vehicle frame, data bytes of serial frame in order
+struct HS_TelemetryFrame {
+    uint32_t seq;
+    uint64_t timestamp;     // CLOCK_MONOTONIC arrival time, nanoseconds
+    uint8_t odo;
+    uint8_t curSpeed;
+    uint8_t batteryLev;
+    uint8_t signalLightLeft;
+    uint8_t signalLightRight;
+    uint8_t source;         // serial port index
+};
+
+/*
+ * telemetry frame dispatcher.
+ * listeners are registered at init before serial reader starts and are
+ * called in the single publishing thread, serial reader or port merger,
+ * so they must not block.
+ * The latest frame is kept in a seqlock snapshot, getLatest never blocks
+ * the publishing thread and never takes a lock.
+ */
+class HS_Telemetry {
+public:
+    typedef void (*listener_func)(const HS_TelemetryFrame &frame);
+
+    HS_Telemetry() = default;
+    ~HS_Telemetry() = default;
+    HS_Telemetry(HS_Telemetry const &) = delete;
+    HS_Telemetry &operator=(HS_Telemetry const &) = delete;
+
+    static HS_Telemetry* instance(void);
+    static uint64_t now(void);
+    int addListener(listener_func f);
+    static bool decode(const unsigned char *msg, int length, HS_TelemetryFrame *frame);
+    void publish(const HS_TelemetryFrame &frame);
+    bool getLatest(HS_TelemetryFrame *frame) const;
+
+private:
+    void storeLatest(const HS_TelemetryFrame &frame);
+
+private:
+    listener_func listeners[HS_TELEMETRY_MAX_LISTENER] = {};
+    std::atomic<int> listener_count {0};
+    uint32_t seq = 0;
+
+    // seqlock, odd while single writer updates the words
+    static const int SNAPSHOT_WORDS = (sizeof(HS_TelemetryFrame) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    std::atomic<uint64_t> snapshot_seq {0};
+    std::atomic<uint64_t> snapshot[SNAPSHOT_WORDS] = {};
+};
+
+/*
+ * per receiver delivery state, decides whether and which fields of a frame
+ * are sent. mask is HS_TELEMETRY_FIELD_* plus HS_TELEMETRY_KEYFRAME,
+ * 0 : frame is skipped for this receiver.
+ *  - max_rate : frames per second at most, 0 : every frame
+ *  - threshold : when any is set, only a change of at least threshold
+ *                of a watched field delivers a frame
+ *  - delta : only changed fields are sent, with a keyframe every
+ *            keyframe_interval frames. When disabled every frame is a keyframe.
+ */
+struct HS_TelemetryFilter {
+    bool enabled = false;   // delta mode
+    uint32_t keyframe_interval = HS_TELEMETRY_KEYFRAME_INTERVAL;
+    uint64_t min_interval_ns = 0;
+    int threshold[HS_TELEMETRY_FIELD_COUNT] = {};
+    unsigned int watched = 0;   // fields with threshold
+
+    uint32_t since_keyframe = 0;
+    bool have_last = false;
+    HS_TelemetryFrame last;     // fields as the receiver knows them
+
+    bool setOption(const char *key, const char *value);
+    unsigned int mask(const HS_TelemetryFrame &frame) const;
+    void sent(const HS_TelemetryFrame &frame, unsigned int mask);
+    void reset(void) { have_last = false; }
+};
+
+const char* hs_telemetry_field_name(int index);
+int hs_telemetry_field_value(const HS_TelemetryFrame &frame, int index);
+unsigned int hs_telemetry_changed(const HS_TelemetryFrame &a, const HS_TelemetryFrame &b);
+size_t hs_telemetry_encode_delta(const HS_TelemetryFrame &frame, unsigned int mask, unsigned char *buf);
+size_t hs_telemetry_encode(const HS_TelemetryFrame &frame, unsigned char *buf);
+int hs_telemetry_decode(const unsigned char *buf, size_t len, HS_TelemetryFrame *frame);
+
+#endif // HOMESCREEN_TELEMETRY_H
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * afb binding v3 subset used by homescreen binding, for the host side
+ * benchmark and test tools only. events fan out to a counter instead of
+ * websockets, pushed objects are released by a job thread like afb does.
+ */
+
+#ifndef HOMESCREEN_SIM_AFB_BINDING_H
+#define HOMESCREEN_SIM_AFB_BINDING_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct json_object;
+
+struct afb_api_x3 {
+    const char *apiname;
+};
+typedef struct afb_api_x3 *afb_api_t;
+
+// one simulated client session and the request it sends
+struct afb_req_x3 {
+    afb_api_t api;
+    const char *appid;                  // afb_req_get_application_id
+    struct json_object *args;           // afb_req_json, not owned
+    void *context;
+    void (*context_free)(void*);
+};
+typedef struct afb_req_x3 *afb_req_t;
+
+struct afb_event_x3;
+typedef struct afb_event_x3 *afb_event_t;
+
+typedef struct {
+    const char *verb;
+    void (*callback)(afb_req_t req);
+    const void *auth;
+    const char *info;
+    void *vcbdata;
+    unsigned session;
+    unsigned glob;
+} afb_verb_t;
+
+typedef struct {
+    const char *api;
+    const char *specification;
+    const char *info;
+    const afb_verb_t *verbs;
+    int (*preinit)(afb_api_t api);
+    int (*init)(afb_api_t api);
+    void (*onevent)(afb_api_t api, const char *event, struct json_object *object);
+    void *userdata;
+    const char *provide_class;
+    const char *require_class;
+    const char *require_api;
+    unsigned noconcurrency;
+} afb_binding_t;
+
+void hs_sim_log(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define AFB_ERROR(...)      hs_sim_log(3, __VA_ARGS__)
+#define AFB_WARNING(...)    hs_sim_log(4, __VA_ARGS__)
+#define AFB_NOTICE(...)     hs_sim_log(5, __VA_ARGS__)
+#define AFB_INFO(...)       hs_sim_log(6, __VA_ARGS__)
+#define AFB_DEBUG(...)      hs_sim_log(7, __VA_ARGS__)
+
+struct json_object *afb_req_json(afb_req_t req);
+const char *afb_req_value(afb_req_t req, const char *name);
+void afb_req_success(afb_req_t req, struct json_object *obj, const char *info);
+void afb_req_success_f(afb_req_t req, struct json_object *obj, const char *info, ...);
+void afb_req_fail(afb_req_t req, const char *status, const char *info);
+void afb_req_fail_f(afb_req_t req, const char *status, const char *info, ...);
+int afb_req_subscribe(afb_req_t req, afb_event_t event);
+int afb_req_unsubscribe(afb_req_t req, afb_event_t event);
+void *afb_req_context_get(afb_req_t req);
+void afb_req_context_set(afb_req_t req, void *context, void (*free_context)(void*));
+int afb_req_session_set_LOA(afb_req_t req, unsigned level);
+char *afb_req_get_application_id(afb_req_t req);
+
+afb_event_t afb_api_make_event(afb_api_t api, const char *name);
+int afb_event_push(afb_event_t event, struct json_object *object);
+void afb_event_unref(afb_event_t event);
+
+void afb_api_call(afb_api_t api, const char *apiname, const char *verb, struct json_object *args,
+                  void (*callback)(void *closure, struct json_object *object, const char *error,
+                                   const char *info, afb_api_t api),
+                  void *closure);
+int afb_api_call_sync(afb_api_t api, const char *apiname, const char *verb, struct json_object *args,
+                      struct json_object **object, char **error, char **info);
+int afb_api_queue_job(afb_api_t api, void (*callback)(int signum, void *arg), void *argument,
+                      void *group, int timeout);
+
+/*
+ * simulator controls
+ */
+// log messages up to level are written to stderr, default 3 : errors
+void hs_sim_set_verbosity(int level);
+// answers afb_api_call_sync, nullptr : every call fails
+typedef int (*hs_sim_call_func)(const char *apiname, const char *verb, struct json_object *args,
+                                struct json_object **object);
+void hs_sim_set_call_handler(hs_sim_call_func f);
+// sees every object pushed to an event with subscribers before afb owns it
+typedef void (*hs_sim_push_func)(afb_event_t event, struct json_object *object);
+void hs_sim_set_push_hook(hs_sim_push_func f);
+// wait until job thread released every pushed object
+void hs_sim_drain(void);
+// pushes which reached at least one subscriber, pushes which reached
+// nobody, events alive
+unsigned long hs_sim_event_pushes(void);
+unsigned long hs_sim_event_unheard(void);
+long hs_sim_event_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOMESCREEN_SIM_AFB_BINDING_H
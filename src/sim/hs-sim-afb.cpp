@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdarg>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <afb/afb-binding.h>
+#include <json-c/json.h>
+
+struct afb_event_x3 {
+    std::string name;
+    std::atomic<int> listeners {0};
+};
+
+/*
+ * afb serializes a pushed event and releases it in its own job thread,
+ * the job thread here does the same so object references are released
+ * concurrently with the binding like on target
+ */
+struct SimJobs {
+    std::mutex mtx;
+    std::condition_variable cond;
+    std::condition_variable idle;
+    std::deque<struct json_object*> queue;
+    bool busy = false;
+
+    SimJobs()
+    {
+        std::thread(&SimJobs::run, this).detach();
+    }
+
+    void push(struct json_object *obj)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        queue.push_back(obj);
+        cond.notify_one();
+    }
+
+    void drain(void)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        idle.wait(lock, [this] { return queue.empty() && !busy; });
+    }
+
+    void run(void)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        for(;;) {
+            cond.wait(lock, [this] { return !queue.empty(); });
+            struct json_object *obj = queue.front();
+            queue.pop_front();
+            busy = true;
+            lock.unlock();
+            json_object_to_json_string(obj);
+            json_object_put(obj);
+            lock.lock();
+            busy = false;
+            if(queue.empty())
+                idle.notify_all();
+        }
+    }
+};
+
+static SimJobs* jobs(void)
+{
+    static SimJobs *me = new SimJobs();    // never destroyed, thread is detached
+    return me;
+}
+
+static int verbosity = 3;
+static hs_sim_call_func call_handler = nullptr;
+static hs_sim_push_func push_hook = nullptr;
+static std::atomic<unsigned long> event_pushes {0};
+static std::atomic<unsigned long> event_unheard {0};
+static std::atomic<long> event_count {0};
+
+void hs_sim_log(int level, const char *fmt, ...)
+{
+    if(level > verbosity)
+        return;
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+struct json_object *afb_req_json(afb_req_t req)
+{
+    return req->args;
+}
+
+const char *afb_req_value(afb_req_t req, const char *name)
+{
+    struct json_object *value;
+    if(!json_object_object_get_ex(req->args, name, &value))
+        return nullptr;
+    return json_object_get_string(value);
+}
+
+void afb_req_success(afb_req_t req, struct json_object *obj, const char *info)
+{
+    (void)req;
+    (void)info;
+    json_object_put(obj);
+}
+
+void afb_req_success_f(afb_req_t req, struct json_object *obj, const char *info, ...)
+{
+    afb_req_success(req, obj, info);
+}
+
+void afb_req_fail(afb_req_t req, const char *status, const char *info)
+{
+    (void)req;
+    (void)status;
+    (void)info;
+}
+
+void afb_req_fail_f(afb_req_t req, const char *status, const char *info, ...)
+{
+    afb_req_fail(req, status, info);
+}
+
+int afb_req_subscribe(afb_req_t req, afb_event_t event)
+{
+    (void)req;
+    event->listeners.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+int afb_req_unsubscribe(afb_req_t req, afb_event_t event)
+{
+    (void)req;
+    event->listeners.fetch_sub(1, std::memory_order_relaxed);
+    return 0;
+}
+
+void *afb_req_context_get(afb_req_t req)
+{
+    return req->context;
+}
+
+void afb_req_context_set(afb_req_t req, void *context, void (*free_context)(void*))
+{
+    req->context = context;
+    req->context_free = free_context;
+}
+
+int afb_req_session_set_LOA(afb_req_t req, unsigned level)
+{
+    (void)req;
+    (void)level;
+    return 0;
+}
+
+char *afb_req_get_application_id(afb_req_t req)
+{
+    return req->appid != nullptr ? strdup(req->appid) : nullptr;
+}
+
+afb_event_t afb_api_make_event(afb_api_t api, const char *name)
+{
+    (void)api;
+    afb_event_t event = new afb_event_x3;
+    event->name = name;
+    event_count.fetch_add(1, std::memory_order_relaxed);
+    return event;
+}
+
+int afb_event_push(afb_event_t event, struct json_object *object)
+{
+    int listeners = event->listeners.load(std::memory_order_relaxed);
+    if(listeners <= 0) {
+        event_unheard.fetch_add(1, std::memory_order_relaxed);
+        json_object_put(object);
+        return 0;
+    }
+    event_pushes.fetch_add(1, std::memory_order_relaxed);
+    if(push_hook != nullptr)
+        push_hook(event, object);
+    jobs()->push(object);
+    return listeners;
+}
+
+void afb_event_unref(afb_event_t event)
+{
+    if(event == nullptr)
+        return;
+    delete event;
+    event_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void afb_api_call(afb_api_t api, const char *apiname, const char *verb, struct json_object *args,
+                  void (*callback)(void *closure, struct json_object *object, const char *error,
+                                   const char *info, afb_api_t api),
+                  void *closure)
+{
+    struct json_object *object = nullptr;
+    int ret = afb_api_call_sync(api, apiname, verb, args, &object, nullptr, nullptr);
+    if(callback != nullptr)
+        callback(closure, object, ret < 0 ? "unavailable" : nullptr, nullptr, api);
+    json_object_put(object);
+}
+
+int afb_api_call_sync(afb_api_t api, const char *apiname, const char *verb, struct json_object *args,
+                      struct json_object **object, char **error, char **info)
+{
+    (void)api;
+    if(error != nullptr)
+        *error = nullptr;
+    if(info != nullptr)
+        *info = nullptr;
+    *object = nullptr;
+    int ret = call_handler != nullptr ? call_handler(apiname, verb, args, object) : -1;
+    json_object_put(args);
+    return ret;
+}
+
+int afb_api_queue_job(afb_api_t api, void (*callback)(int signum, void *arg), void *argument,
+                      void *group, int timeout)
+{
+    (void)api;
+    (void)group;
+    (void)timeout;
+    callback(0, argument);
+    return 0;
+}
+
+void hs_sim_set_verbosity(int level)
+{
+    verbosity = level;
+}
+
+void hs_sim_set_call_handler(hs_sim_call_func f)
+{
+    call_handler = f;
+}
+
+void hs_sim_set_push_hook(hs_sim_push_func f)
+{
+    push_hook = f;
+}
+
+void hs_sim_drain(void)
+{
+    jobs()->drain();
+}
+
+unsigned long hs_sim_event_pushes(void)
+{
+    return event_pushes.load(std::memory_order_relaxed);
+}
+
+unsigned long hs_sim_event_unheard(void)
+{
+    return event_unheard.load(std::memory_order_relaxed);
+}
+
+long hs_sim_event_count(void)
+{
+    return event_count.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <json-c/json.h>
+
+struct json_object {
+    std::atomic<int> ref {1};
+    json_type type;
+    int64_t i = 0;
+    std::string s;
+    struct lh_entry *head = nullptr;    // object members in insertion order
+    struct lh_entry *tail = nullptr;
+    std::vector<struct json_object*> array;
+    std::string pb;                     // to_json_string buffer, like json-c _pb
+
+    explicit json_object(json_type type) : type(type) {}
+};
+
+static std::atomic<long> live {0};
+static std::atomic<long> allocs {0};
+
+static struct json_object *json_new(json_type type)
+{
+    live.fetch_add(1, std::memory_order_relaxed);
+    allocs.fetch_add(1, std::memory_order_relaxed);
+    return new json_object(type);
+}
+
+static void json_free(struct json_object *obj)
+{
+    struct lh_entry *e = obj->head;
+    while(e != nullptr) {
+        struct lh_entry *next = e->next;
+        free((void*)e->k);
+        json_object_put((struct json_object*)e->v);
+        delete e;
+        e = next;
+    }
+    for(auto v : obj->array)
+        json_object_put(v);
+    delete obj;
+    live.fetch_sub(1, std::memory_order_relaxed);
+}
+
+static void json_escape(std::string &out, const std::string &s)
+{
+    out += '"';
+    for(char c : s) {
+        if(c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        }
+        else if((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        }
+        else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+static void json_serialize(std::string &out, const struct json_object *obj)
+{
+    if(obj == nullptr) {
+        out += "null";
+        return;
+    }
+    switch(obj->type) {
+    case json_type_boolean:
+        out += obj->i ? "true" : "false";
+        break;
+    case json_type_int: {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%" PRId64, obj->i);
+        out += buf;
+        break;
+    }
+    case json_type_string:
+        json_escape(out, obj->s);
+        break;
+    case json_type_object:
+        out += '{';
+        for(struct lh_entry *e = obj->head; e != nullptr; e = e->next) {
+            if(e != obj->head)
+                out += ',';
+            json_escape(out, (const char*)e->k);
+            out += ':';
+            json_serialize(out, (const struct json_object*)e->v);
+        }
+        out += '}';
+        break;
+    case json_type_array:
+        out += '[';
+        for(size_t n = 0; n < obj->array.size(); ++n) {
+            if(n != 0)
+                out += ',';
+            json_serialize(out, obj->array[n]);
+        }
+        out += ']';
+        break;
+    default:
+        out += "null";
+        break;
+    }
+}
+
+struct json_object *json_object_new_object(void)
+{
+    return json_new(json_type_object);
+}
+
+struct json_object *json_object_new_array(void)
+{
+    return json_new(json_type_array);
+}
+
+struct json_object *json_object_new_string(const char *s)
+{
+    struct json_object *obj = json_new(json_type_string);
+    obj->s = s != nullptr ? s : "";
+    return obj;
+}
+
+struct json_object *json_object_new_int(int32_t i)
+{
+    struct json_object *obj = json_new(json_type_int);
+    obj->i = i;
+    return obj;
+}
+
+struct json_object *json_object_new_int64(int64_t i)
+{
+    struct json_object *obj = json_new(json_type_int);
+    obj->i = i;
+    return obj;
+}
+
+struct json_object *json_object_new_boolean(int b)
+{
+    struct json_object *obj = json_new(json_type_boolean);
+    obj->i = b != 0;
+    return obj;
+}
+
+struct json_object *json_object_get(struct json_object *obj)
+{
+    if(obj != nullptr)
+        obj->ref.fetch_add(1, std::memory_order_relaxed);
+    return obj;
+}
+
+int json_object_put(struct json_object *obj)
+{
+    if(obj == nullptr)
+        return 0;
+    int ref = obj->ref.fetch_sub(1, std::memory_order_acq_rel);
+    if(ref <= 0) {
+        fprintf(stderr, "json object %p released too often\n", (void*)obj);
+        abort();
+    }
+    if(ref > 1)
+        return 0;
+    json_free(obj);
+    return 1;
+}
+
+json_type json_object_get_type(const struct json_object *obj)
+{
+    return obj != nullptr ? obj->type : json_type_null;
+}
+
+int json_object_is_type(const struct json_object *obj, json_type type)
+{
+    return json_object_get_type(obj) == type;
+}
+
+const char *json_object_get_string(struct json_object *obj)
+{
+    if(obj == nullptr)
+        return nullptr;
+    if(obj->type == json_type_string)
+        return obj->s.c_str();
+    return json_object_to_json_string(obj);
+}
+
+int32_t json_object_get_int(const struct json_object *obj)
+{
+    if(obj == nullptr)
+        return 0;
+    if(obj->type == json_type_string)
+        return (int32_t)strtol(obj->s.c_str(), nullptr, 0);
+    return (int32_t)obj->i;
+}
+
+int json_object_object_add(struct json_object *obj, const char *key, struct json_object *val)
+{
+    if(obj == nullptr || obj->type != json_type_object)
+        return -1;
+    for(struct lh_entry *e = obj->head; e != nullptr; e = e->next) {
+        if(strcmp((const char*)e->k, key) == 0) {
+            if(e->v != val)
+                json_object_put((struct json_object*)e->v);
+            e->v = val;
+            return 0;
+        }
+    }
+    struct lh_entry *e = new lh_entry {strdup(key), val, nullptr};
+    if(obj->tail != nullptr)
+        obj->tail->next = e;
+    else
+        obj->head = e;
+    obj->tail = e;
+    return 0;
+}
+
+int json_object_object_get_ex(const struct json_object *obj, const char *key, struct json_object **value)
+{
+    if(obj != nullptr && obj->type == json_type_object) {
+        for(struct lh_entry *e = obj->head; e != nullptr; e = e->next) {
+            if(strcmp((const char*)e->k, key) == 0) {
+                if(value != nullptr)
+                    *value = (struct json_object*)e->v;
+                return 1;
+            }
+        }
+    }
+    if(value != nullptr)
+        *value = nullptr;
+    return 0;
+}
+
+struct lh_entry *json_object_get_object_head(struct json_object *obj)
+{
+    return (obj != nullptr && obj->type == json_type_object) ? obj->head : nullptr;
+}
+
+size_t json_object_array_length(const struct json_object *obj)
+{
+    return (obj != nullptr && obj->type == json_type_array) ? obj->array.size() : 0;
+}
+
+struct json_object *json_object_array_get_idx(const struct json_object *obj, size_t idx)
+{
+    if(obj == nullptr || obj->type != json_type_array || idx >= obj->array.size())
+        return nullptr;
+    return obj->array[idx];
+}
+
+int json_object_array_add(struct json_object *obj, struct json_object *val)
+{
+    if(obj == nullptr || obj->type != json_type_array)
+        return -1;
+    obj->array.push_back(val);
+    return 0;
+}
+
+const char *json_object_to_json_string(struct json_object *obj)
+{
+    if(obj == nullptr)
+        return "null";
+    obj->pb.clear();
+    json_serialize(obj->pb, obj);
+    return obj->pb.c_str();
+}
+
+int json_object_deep_copy(struct json_object *src, struct json_object **dst, json_c_shallow_copy_fn *shallow_copy)
+{
+    if(src == nullptr || dst == nullptr || *dst != nullptr || shallow_copy != nullptr)
+        return -1;
+
+    struct json_object *copy = json_new(src->type);
+    copy->i = src->i;
+    copy->s = src->s;
+    for(struct lh_entry *e = src->head; e != nullptr; e = e->next) {
+        struct json_object *v = nullptr;
+        if(e->v != nullptr && json_object_deep_copy((struct json_object*)e->v, &v, nullptr) != 0) {
+            json_object_put(copy);
+            return -1;
+        }
+        json_object_object_add(copy, (const char*)e->k, v);
+    }
+    for(auto a : src->array) {
+        struct json_object *v = nullptr;
+        if(a != nullptr && json_object_deep_copy(a, &v, nullptr) != 0) {
+            json_object_put(copy);
+            return -1;
+        }
+        copy->array.push_back(v);
+    }
+    *dst = copy;
+    return 0;
+}
+
+struct json_object *json_tokener_parse(const char *str)
+{
+    (void)str;
+    return nullptr;
+}
+
+int hs_sim_json_refcount(const struct json_object *obj)
+{
+    return obj != nullptr ? obj->ref.load(std::memory_order_relaxed) : 0;
+}
+
+long hs_sim_json_live(void)
+{
+    return live.load(std::memory_order_relaxed);
+}
+
+long hs_sim_json_allocs(void)
+{
+    return allocs.load(std::memory_order_relaxed);
+}
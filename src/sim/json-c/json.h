@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2019 TOYOTA MOTOR CORPORATION
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * json-c subset used by homescreen binding, for the host side benchmark
+ * and test tools only. reference counts are atomic and every object is
+ * counted, so a tool can check that references are balanced.
+ * json_tokener_parse isn't supported and returns nullptr.
+ */
+
+#ifndef HOMESCREEN_SIM_JSON_H
+#define HOMESCREEN_SIM_JSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct json_object;
+
+typedef enum json_type {
+    json_type_null,
+    json_type_boolean,
+    json_type_double,
+    json_type_int,
+    json_type_object,
+    json_type_array,
+    json_type_string
+} json_type;
+
+struct lh_entry {
+    const void *k;
+    const void *v;
+    struct lh_entry *next;
+};
+
+struct json_object *json_object_new_object(void);
+struct json_object *json_object_new_array(void);
+struct json_object *json_object_new_string(const char *s);
+struct json_object *json_object_new_int(int32_t i);
+struct json_object *json_object_new_int64(int64_t i);
+struct json_object *json_object_new_boolean(int b);
+struct json_object *json_object_get(struct json_object *obj);
+int json_object_put(struct json_object *obj);
+
+json_type json_object_get_type(const struct json_object *obj);
+int json_object_is_type(const struct json_object *obj, json_type type);
+const char *json_object_get_string(struct json_object *obj);
+int32_t json_object_get_int(const struct json_object *obj);
+int json_object_object_add(struct json_object *obj, const char *key, struct json_object *val);
+int json_object_object_get_ex(const struct json_object *obj, const char *key, struct json_object **value);
+struct lh_entry *json_object_get_object_head(struct json_object *obj);
+size_t json_object_array_length(const struct json_object *obj);
+struct json_object *json_object_array_get_idx(const struct json_object *obj, size_t idx);
+int json_object_array_add(struct json_object *obj, struct json_object *val);
+const char *json_object_to_json_string(struct json_object *obj);
+typedef int (json_c_shallow_copy_fn)(struct json_object *src, struct json_object *parent, const char *key,
+                                     size_t index, struct json_object **dst);
+int json_object_deep_copy(struct json_object *src, struct json_object **dst, json_c_shallow_copy_fn *shallow_copy);
+struct json_object *json_tokener_parse(const char *str);
+
+#define json_object_object_foreach(obj, key, val) \
+    char *key = NULL; \
+    struct json_object *val = NULL; \
+    for(struct lh_entry *entry ## key = json_object_get_object_head(obj); \
+        ({ if(entry ## key) { key = (char*)entry ## key->k; val = (struct json_object*)entry ## key->v; } ; entry ## key; }); \
+        entry ## key = entry ## key->next)
+
+/*
+ * simulator introspection
+ */
+// reference count of obj
+int hs_sim_json_refcount(const struct json_object *obj);
+// objects allocated and not released yet
+long hs_sim_json_live(void);
+// objects allocated since start
+long hs_sim_json_allocs(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOMESCREEN_SIM_JSON_H